@@ -64,8 +64,16 @@ AnnotationReader::AnnotationReader(const string& directory, const string& folder
         }
         break;
 
-        case 1: //number people
+        case 1: //image size, number people
         {
+          int size_ind = line.find("Image size");
+          if (size_ind >= 0)
+          {
+            //"Image size (X x Y x C) : 640 x 480 x 3"
+            sscanf(line.c_str() + line.find(':') + 1, "%d x %d", &new_img.width, &new_img.height);
+            continue;
+          }
+
           int g_truth_ind = line.find("ground truth");
           if (g_truth_ind < 0)
             continue;
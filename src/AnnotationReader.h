@@ -17,8 +17,12 @@ struct Img_Coordinates
 struct Image_Info
 {
   std::string image_name;
+  //from the "Image size" line, 0 when the annotation has none
+  int width;
+  int height;
   std::vector<Img_Coordinates> people_coordinates;
   
+  Image_Info():width(0),height(0){}
 };
 
 
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include "CoverageMap.h"
+
+using namespace std;
+
+CoverageMap::CoverageMap(const FeaturePyramid::Param& pyramid_param, int person_height)
+  :_param(pyramid_param),_person_height(person_height),_total(0)
+{
+  if (_param.scale_step <= 1)
+    throw runtime_error( boost::str(boost::format("Pyramid scale step %1% should be > 1") % _param.scale_step) );
+  if (person_height < 1)
+    throw runtime_error( boost::str(boost::format("Invalid person height %1%") % person_height) );
+}
+
+int CoverageMap::assignLevel(const Img_Coordinates& person) const
+{
+  //person_height = (y_max - y_min + 1) * scale_step^-l, rounded to the nearest level; a person
+  //smaller than person_height is only seen at level 0
+  float h = (float)(person.y_max - person.y_min + 1);
+  int level = (int)floor(log(h / _person_height) / log(_param.scale_step) + 0.5f);
+  return max(0, min(level, levels() - 1));
+}
+
+void CoverageMap::build(const Image_Info& info, int width, int height)
+{
+  if (width <= 0 || height <= 0)
+  {
+    width = info.width;
+    height = info.height;
+  }
+  if (width <= 0 || height <= 0)
+    throw runtime_error( boost::str(boost::format("No image size for %1%") % info.image_name) );
+
+  //the levels of FeaturePyramid::build
+  _scales.clear();
+  _widths.clear();
+  _heights.clear();
+  for (int l = 0; _param.max_levels <= 0 || l < _param.max_levels; ++l)
+  {
+    float scale = pow(_param.scale_step, -(float)l);
+    int w = (int)(width*scale + 0.5f), h = (int)(height*scale + 0.5f);
+    if (w < _param.window_width || h < _param.window_height)
+      break;
+    _scales.push_back(scale);
+    _widths.push_back(w);
+    _heights.push_back(h);
+  }
+
+  _masks.resize(levels());
+  _integrals.resize(levels());
+  for (int l = 0; l < levels(); ++l)
+    _masks[l].assign((size_t)_widths[l]*_heights[l], 0);
+
+  //each person box, scaled to its level like FeaturePyramid::image_box in reverse
+  for (size_t i = 0; i < info.people_coordinates.size(); ++i)
+  {
+    const Img_Coordinates& person = info.people_coordinates[i];
+    if (levels() == 0)
+      break;
+    int l = assignLevel(person);
+    float s = _scales[l];
+    int x0 = max((int)(person.x_min*s + 0.5f), 0);
+    int y0 = max((int)(person.y_min*s + 0.5f), 0);
+    int x1 = min((int)((person.x_max + 1)*s + 0.5f) - 1, _widths[l] - 1);
+    int y1 = min((int)((person.y_max + 1)*s + 0.5f) - 1, _heights[l] - 1);
+    for (int y = y0; y <= y1; ++y)
+      for (int x = x0; x <= x1; ++x)
+        _masks[l][(size_t)y*_widths[l] + x] = 1;
+  }
+
+  _total = 0;
+  for (int l = 0; l < levels(); ++l)
+  {
+    int w = _widths[l], h = _heights[l];
+    vector<uint32_t>& integral = _integrals[l];
+    integral.assign((size_t)(w + 1)*(h + 1), 0);
+    for (int y = 0; y < h; ++y)
+    {
+      uint32_t row = 0;
+      const uint8_t* m = &_masks[l][(size_t)y*w];
+      uint32_t* above = &integral[(size_t)y*(w + 1)];
+      uint32_t* out = above + w + 1;
+      for (int x = 0; x < w; ++x)
+      {
+        row += m[x];
+        out[x + 1] = above[x + 1] + row;
+      }
+    }
+    _total += integral.back();
+  }
+}
+
+uint32_t CoverageMap::count(int level, int x0, int y0, int x1, int y1) const
+{
+  if (level < 0 || level >= levels())
+    throw runtime_error( boost::str(boost::format("Level %1% is outside the %2% levels") % level % levels()) );
+  x0 = max(x0, 0);
+  y0 = max(y0, 0);
+  x1 = min(x1, _widths[level] - 1);
+  y1 = min(y1, _heights[level] - 1);
+  if (x1 < x0 || y1 < y0)
+    return 0;
+
+  const vector<uint32_t>& integral = _integrals[level];
+  size_t stride = _widths[level] + 1;
+  return integral[(y1 + 1)*stride + x1 + 1] - integral[y0*stride + x1 + 1]
+    - integral[(y1 + 1)*stride + x0] + integral[y0*stride + x0];
+}
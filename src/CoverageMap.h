@@ -0,0 +1,57 @@
+#ifndef COVERAGE_MAP_H
+#define COVERAGE_MAP_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "AnnotationReader.h"
+#include "feature_pyramid.h"
+
+//Ground truth G of one image for the coverage utility f_G(A) = |C(A) n G| of the writeup. Every
+//labeled person is assigned to the pyramid level where its height is closest to person_height
+//(the level where a window detects it); level l holds a mask of the boxes assigned to it plus the
+//integral image of that mask, so the ground truth pixels under any window (x, y, level) take 4 lookups.
+//The levels are those of a FeaturePyramid with the same Param: level l is the image scaled by
+//scale_step^-l, down to the last level that holds a window.
+class CoverageMap
+{
+  public:
+    CoverageMap(const FeaturePyramid::Param& pyramid_param, int person_height = 96);
+
+    //width and height default to those of the annotation
+    void build(const Image_Info& info, int width = 0, int height = 0);
+
+    inline int levels() const { return (int)_scales.size(); }
+    inline float scale(int level) const { return _scales[level]; }
+    inline int width(int level) const { return _widths[level]; }
+    inline int height(int level) const { return _heights[level]; }
+    inline int windowWidth() const { return _param.window_width; }
+    inline int windowHeight() const { return _param.window_height; }
+
+    //level a person box of the image is assigned to
+    int assignLevel(const Img_Coordinates& person) const;
+
+    //mask of level l, row major, 1 on ground truth pixels
+    inline const uint8_t* mask(int level) const { return &_masks[level][0]; }
+    //ground truth pixels of [x0, x1] x [y0, y1] (inclusive, level pixels, clipped to the level)
+    uint32_t count(int level, int x0, int y0, int x1, int y1) const;
+    //ground truth pixels under the window with top-left corner (x, y) of a level
+    inline uint32_t coverage(int x, int y, int level) const
+    {
+      return count(level, x, y, x + _param.window_width - 1, y + _param.window_height - 1);
+    }
+    //|G|, ground truth pixels over all levels
+    inline uint32_t total() const { return _total; }
+
+  private:
+    FeaturePyramid::Param _param;
+    int _person_height;
+    std::vector<float> _scales;
+    std::vector<int> _widths;
+    std::vector<int> _heights;
+    std::vector<std::vector<uint8_t> > _masks;
+    std::vector<std::vector<uint32_t> > _integrals;   //(width + 1) x (height + 1), row major, zero first row and column
+    uint32_t _total;
+};
+
+#endif //COVERAGE_MAP_H
@@ -1,3 +1,16 @@
 #!/bin/bash
+set -e
 
 ./hog -i test.jpg -k test.kps -p 64 -o test.hog
+./hog -i test.jpg -s 8 -o /dev/null
+./hog -i test.jpg -s 8 -b 2 -o /dev/null
+./hog -i test.jpg -s 8 -t 4 -o /dev/null
+./hog -i test.jpg -s 8 -q -o /dev/null
+./hog -i test.jpg -l 1.2 -p 64 -o /dev/null
+./hog -i test.jpg -m 1.2 -p 64 -o /dev/null
+./hog -i test.jpg -m 1.2 -p 31 -g 7 -o test7.hog
+./hog -i test.jpg -m 1.2 -p 31 -g 7 -t 4 -o test7_t4.hog
+cmp test7.hog test7_t4.hog
+rm test7.hog test7_t4.hog
+#built by "make bench", greedy NMS of every window checked against the all-pairs algorithm
+./bench_cascade -r . -l test.lst -g test.lst -n 1 -T -1000
@@ -0,0 +1,70 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Soft cascade evaluation of a linear window classifier: the score is accumulated
+//              one cell (or block) at a time in a learned order and the window is rejected as
+//              soon as the partial score falls below the threshold of its stage.
+//
+// Reference
+// L. Bourdev and J. Brandt, "Robust object detection via soft cascade", CVPR 2005.
+// C. Zhang and P. Viola, "Multiple-instance pruning for learning efficient cascade detectors",
+// NIPS 2007 (direct backward pruning of the stage thresholds).
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include "cell_map.h"
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+class SoftCascade
+{
+	public:
+		//weights in the descriptor order of HOGExtractor, unit (i, j) of xgrid x ygrid at (i*ygrid + j)*unit,
+		//as for LinearDetector; stages start in descriptor order without thresholds
+		SoftCascade(const float *weights, int xgrid, int ygrid, int unit, float bias = 0);
+
+		inline int stages() const { return _xgrid * _ygrid; }
+		inline int length() const { return _xgrid * _ygrid * _unit; }
+		//unit i*ygrid + j evaluated at stage k
+		inline int order(int k) const { return _order[k]; }
+		inline float threshold(int k) const { return _thresholds[k]; }
+
+		//stages by decreasing mean |w_u . x_u| over count descriptors, so that the units that move the
+		//score most come first; the thresholds are reset
+		void learn_order(const float *dscr, size_t stride, int count);
+		//direct backward pruning on count positive descriptors: of the positives the full model scores
+		//>= threshold, stage k keeps all but a miss_rate fraction of those alive after stage k - 1
+		void calibrate(const float *dscr, size_t stride, int count, float threshold, float miss_rate = 0);
+		//full evaluation, every stage runs
+		void reset_thresholds();
+
+		//cascade score of a descriptor, false when a stage rejects it; stages_run gets the stages evaluated
+		bool score(float &score, const float *dscr, int *stages_run = NULL) const;
+		//windows [cx cy] of a map, given by their top-left cell or block; rejected windows score -FLT_MAX.
+		//Returns the number of stages evaluated over all windows
+		long score(float *scores, const int32_t *windows, int count, const CellMap &cells) const;
+		long score(float *scores, const int32_t *windows, int count, const BlockMap &blocks) const;
+
+		//text file: xgrid ygrid unit, then one line "unit threshold" per stage
+		void save(const char *fn) const;
+		void load(const char *fn);
+
+	private:
+		template<typename Map>
+		long score_map(float *scores, const int32_t *windows, int count, const Map &map) const;
+		void set_order(const std::vector<int> &order);
+
+		int _xgrid;
+		int _ygrid;
+		int _unit;
+		float _bias;
+		std::vector<float> _weights;
+		std::vector<int> _order;
+		std::vector<float> _thresholds;
+		std::vector<int> _dx;   //cell offset of each stage inside the window
+		std::vector<int> _dy;
+};
+
+#endif //CASCADE_H
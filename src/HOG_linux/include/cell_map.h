@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Histograms of a regular lattice of cells, computed once per image so that
+//              overlapping windows aligned to the lattice share their cells, and the
+//              overlapping L2-Hys normalized blocks of such a lattice.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CELL_MAP_H
+#define CELL_MAP_H
+
+#include "integral_histogram.h"
+
+#include <vector>
+
+class CellMap
+{
+	public:
+		CellMap():_cell(0),_cols(0),_rows(0),_dirnum(0){}
+		//histograms of the cells [cx*cell, cy*cell, (cx + 1)*cell - 1, (cy + 1)*cell - 1] that fit
+		//in the image, each computed as by IntegralHistogram::get_window_hist
+		void build(const IntegralHistogram &inthist, int cell, bool normalize = true, int nthreads = 1);
+
+		inline int cell() const { return _cell; }
+		inline int cols() const { return _cols; }
+		inline int rows() const { return _rows; }
+		inline int dirnum() const { return _dirnum; }
+		//the map is x major: the cells (cx, cy), (cx, cy + 1), ... follow each other, dirnum floats apiece
+		inline const float *hist(int cx, int cy) const { return &_hist[(static_cast<size_t>(cx)*_rows + cy)*_dirnum]; }
+
+	private:
+		void build_cols(const IntegralHistogram *inthist, bool normalize, int col_begin, int col_end);
+
+		int _cell;
+		int _cols;
+		int _rows;
+		int _dirnum;
+		std::vector<float> _hist;
+};
+
+//Dalal-Triggs blocks of block x block cells at every cell position of a CellMap, each L2-Hys
+//normalized once and shared by all windows containing it. Block (bx, by) holds the cells
+//(bx + i, by + j), x major, as block*block*dirnum floats
+class BlockMap
+{
+	public:
+		BlockMap():_cell(0),_block(0),_cols(0),_rows(0),_length(0),_clip(0.2f),_avx2(false){}
+		//cells should be built without normalization
+		void build(const CellMap &cells, int block = 2, float clip = 0.2f, int nthreads = 1);
+
+		inline int cell() const { return _cell; }
+		inline int block() const { return _block; }
+		inline int cols() const { return _cols; }
+		inline int rows() const { return _rows; }
+		inline int length() const { return _length; }  //floats per block
+		inline float clip() const { return _clip; }
+		//the blocks (bx, by), (bx, by + 1), ... follow each other
+		inline const float *hist(int bx, int by) const { return &_hist[(static_cast<size_t>(bx)*_rows + by)*_length]; }
+
+	private:
+		void build_cols(const CellMap *cells, int col_begin, int col_end);
+
+		int _cell;
+		int _block;
+		int _cols;
+		int _rows;
+		int _length;
+		float _clip;
+		bool _avx2;
+		std::vector<float> _hist;
+};
+
+#endif //CELL_MAP_H
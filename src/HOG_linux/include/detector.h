@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Dense scoring of a linear window classifier on cell and block maps, without
+//              extracting the window descriptors.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include "cell_map.h"
+#include "feature_pyramid.h"
+
+#include <vector>
+
+//scores of every window of a map, given by its top-left cell (or block); x major like the maps
+class ScoreMap
+{
+	public:
+		ScoreMap():_cols(0),_rows(0){}
+		void resize(int cols, int rows) { _cols = cols; _rows = rows; _score.assign(static_cast<size_t>(cols)*rows, 0); }
+
+		inline int cols() const { return _cols; }
+		inline int rows() const { return _rows; }
+		inline float score(int cx, int cy) const { return _score[static_cast<size_t>(cx)*_rows + cy]; }
+		//the scores (cx, 0), (cx, 1), ... are contiguous
+		inline float *column(int cx) { return &_score[static_cast<size_t>(cx)*_rows]; }
+		inline const float *column(int cx) const { return &_score[static_cast<size_t>(cx)*_rows]; }
+
+	private:
+		int _cols;
+		int _rows;
+		std::vector<float> _score;
+};
+
+//w . descriptor + bias for a window of xgrid x ygrid units (cells or blocks) of unit floats each,
+//weights in the descriptor order of HOGExtractor: unit (i, j) at (i*ygrid + j)*unit.
+//The map is split into one plane per bin and each plane is cross-correlated with the matching
+//xgrid x ygrid filter, a column tile at a time with the partial scores kept in cache; the score
+//of a window equals the dot product with its extracted descriptor up to float summation order
+class LinearDetector
+{
+	public:
+		LinearDetector(const float *weights, int xgrid, int ygrid, int unit, float bias = 0);
+
+		inline int xgrid() const { return _xgrid; }
+		inline int ygrid() const { return _ygrid; }
+		inline int unit() const { return _unit; }
+		inline float bias() const { return _bias; }
+
+		//unit has to be cells.dirnum()
+		void score(ScoreMap &scores, const CellMap &cells, int nthreads = 1) const;
+		//unit has to be blocks.length(), xgrid x ygrid counts blocks
+		void score(ScoreMap &scores, const BlockMap &blocks, int nthreads = 1) const;
+		//every level of a pyramid through a CellMap of cell x cell pixels per level
+		void score(std::vector<ScoreMap> &scores, const FeaturePyramid &pyramid, int cell, bool normalize = true, int nthreads = 1) const;
+
+	private:
+		template<typename Map>
+		void score_map(ScoreMap &scores, const Map &map, int nthreads) const;
+
+		int _xgrid;
+		int _ygrid;
+		int _unit;
+		float _bias;
+		std::vector<float> _filters;   //per bin b, the xgrid x ygrid filter at b*xgrid*ygrid, x major
+};
+
+#endif //DETECTOR_H
@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Image pyramid with an integral histogram per level, for detecting windows of a
+//              fixed size at several scales.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FEATURE_PYRAMID_H
+#define FEATURE_PYRAMID_H
+
+#include "integral_histogram.h"
+#include "hog_extractor.h"
+
+#include <boost/noncopyable.hpp>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+//level l is the image scaled by scale_step^-l, each level resampled from the one above it so that
+//every resampling is a small step. Windows of window_width x window_height level pixels are
+//extracted through one ExtractionPlan per level.
+//
+//In approximate mode only the octaves 2^-k of the image are built from pixels; a level between
+//octaves k and k + 1 resamples the histogram channels of octave k by r = scale / 2^-k and
+//multiplies them by r^-lambda, the power law gradient statistics follow across scales
+//(P. Dollar et al., "Fast feature pyramids for object detection", PAMI 2014)
+class FeaturePyramid : boost::noncopyable
+{
+	public:
+		//power law exponent of gradient histograms across scales, Dollar et al. fit about 0.1 for HOG
+		static const float default_lambda;
+
+		struct Param
+		{
+			float scale_step;   //> 1, size ratio of neighbouring levels
+			int window_width;
+			int window_height;
+			int max_levels;     //0: down to the smallest level that still holds a window
+			int nthreads;       //threads over the levels, each level is built by one thread
+			bool approximate;
+			float lambda;       //power law exponent of the approximate mode
+			Param(float step = 1.2f, int ww = 32, int wh = 32, int ml = 0, int nt = 1, bool ap = false, float la = default_lambda)
+				:scale_step(step),window_width(ww),window_height(wh),max_levels(ml),nthreads(nt),approximate(ap),lambda(la){}
+		};
+
+		FeaturePyramid(Param &param, IntegralHistogram::Param &inthist_param, HOGExtractor::Param &hog_param);
+		~FeaturePyramid();
+
+		void build(const Image &img);
+
+		inline int levels() const { return static_cast<int>(_levels.size()); }
+		//level size / image size
+		inline float scale(int level) const { return _scales[level]; }
+		inline const IntegralHistogram &level(int level) const { return *_levels[level]; }
+		//the level was built from pixels, always true unless approximate
+		inline bool exact(int level) const { return _sources[level] < 0; }
+		inline int length() const { return _hog_param.xgrid * _hog_param.ygrid * _inthist_param.dirnum; }
+
+		//count windows [x y level] of a flat array, (x, y) the top-left corner in level pixels; the
+		//descriptor of window k goes to dscr + k*stride and equals HOGExtractor::extract of the box
+		//[x y x+window_width-1 y+window_height-1] on that level. Windows have to fit their level
+		void extract(float *dscr, size_t stride, const int32_t *windows, int count) const;
+		//the box [x0 y0 x1 y1] a window covers in the original image
+		void image_box(int32_t *box, const int32_t *window) const;
+		//count windows of every level to a flat array of image boxes, e.g. for NonMaxSuppression
+		void image_box(int32_t *boxes, const int32_t *windows, int count) const;
+
+	private:
+		void clear();
+		inline int scaled(int size, float scale) const { return static_cast<int>(size*scale + 0.5f); }
+		void build_exact(const Image &img);
+		void build_approximate(const Image &img);
+		void build_levels(std::vector<Image> *images, std::vector<IntegralHistogram *> *hists, int level_begin, int level_end);
+		void resample_levels(const std::vector<IntegralHistogram *> *octaves, int level_begin, int level_end);
+
+		Param _param;
+		IntegralHistogram::Param _inthist_param;
+		HOGExtractor::Param _hog_param;
+		std::vector<IntegralHistogram *> _levels;
+		std::vector<float> _scales;
+		std::vector<int> _sources;    //octave an approximate level is resampled from, -1 when exact
+		int _image_width;
+		int _image_height;
+		std::vector<ExtractionPlan> _plans;
+};
+
+#endif //FEATURE_PYRAMID_H
@@ -0,0 +1,29 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: AVX2 kernels for 8-bin histograms, where one corner histogram of the interleaved
+//              integral histogram is exactly one 256-bit register, and for L2-Hys block
+//              normalization.
+//
+// The kernels are compiled for AVX2 regardless of the compiler flags and must only be called
+// when hist8_avx2_supported() is true. The 4-corner combine matches the scalar code bit for bit;
+// sums are tree reductions, so normalized results may differ from the scalar path in the last
+// bits.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HIST_SIMD_H
+#define HIST_SIMD_H
+
+//checked once, true when the CPU runs AVX2 and HOG_NO_AVX2 is not set in the environment
+bool hist8_avx2_supported();
+
+//hist = p11 - p01 - p10 + p00 for one cell, divided by its sum + eps when normalize is set
+void hist8_avx2(float *hist, const float *p11, const float *p01, const float *p10, const float *p00, bool normalize, float eps);
+
+//the ygrid cells between two lines of ygrid + 1 corners, 8 floats each:
+//hist[j] = right[j + 1] - left[j + 1] - right[j] + left[j]
+void hist8_column_avx2(float *hist, const float *left, const float *right, int ygrid, bool normalize, float eps);
+
+//L2-Hys in place on count blocks of n floats: v /= sqrt(|v|^2 + eps^2), v = min(v, clip),
+//v /= sqrt(|v|^2 + eps^2); any n
+void l2hys_avx2(float *blocks, int count, int n, float clip, float eps);
+
+#endif //HIST_SIMD_H
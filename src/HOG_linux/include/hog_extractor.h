@@ -41,9 +41,17 @@
 #define HOG_EXTRACTOR_H
 
 #include "integral_histogram.h"
+#include "cell_map.h"
 
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/vector.hpp>
+#include <boost/format.hpp>
+#include <boost/noncopyable.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
 
 using namespace boost::numeric;
 
@@ -55,16 +63,178 @@ class HOGExtractor
 			int xgrid;
 			int ygrid;
 			bool normalize;
-			Param(int xg = 4, int yg = 4, bool n = true):xgrid(xg),ygrid(yg),normalize(n){}
+			int nthreads; //threads of the bbox list extract, the result is identical for any value
+			Param(int xg = 4, int yg = 4, bool n = true, int nt = 1):xgrid(xg),ygrid(yg),normalize(n),nthreads(nt){}
 		};
 
 		HOGExtractor(Param &param):_param(param){};
 		~HOGExtractor(){}
+		//count boxes [x0 y0 x1 y1] of a flat array, descriptor k goes to dscr + k*stride; dscr has to be
+		//64-byte aligned and stride a multiple of 16 floats (aligned_stride, DescriptorBuffer).
+		//8 bins on a 4x4 grid and 9 bins on an 8x16 grid are dispatched to FixedHOGExtractor, other
+		//grids go through an ExtractionPlan of the box size when the box lies inside the image
+		void extract(float *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist);
+		//quantized storage of the same descriptors, no alignment needed: 8-bit rows hold round(255*v)
+		//of the L1 normalized cells (Param::normalize has to be set, see quantized.h for scoring),
+		//16-bit rows hold IEEE half floats
+		void extract(uint8_t *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist);
+		void extract(uint16_t *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist);
+		//multi-scale windows [x y scale] of a flat array on the one integral histogram of the image: the
+		//window is the box [x y x+width*scale-1 y+height*scale-1] (rounded) and its cells grow with it,
+		//no image is resampled. Unnormalized cells are multiplied by scale^(lambda - 2), the pixel count
+		//and power law gain of a pyramid level 1/scale; normalized cells are independent of it
+		void extract_scaled(float *dscr, size_t stride, const float *windows, int count, int width, int height, float lambda, const IntegralHistogram &inthist);
+		//same through ublas. The matrix overload passes the storage of both row-major matrices to
+		//extract_rows as is, so their rows have to be contiguous (the default unbounded_array):
+		//box k is the first 4 entries of row k of bbox_list, descriptor k is row k of dscr_list
 		void extract(ublas::matrix<float> &dscr_list, const ublas::matrix<int> &bbox_list, const IntegralHistogram &inthist);
 		void extract(ublas::vector<float> &dscr, const ublas::vector<int> &bbox, const IntegralHistogram &inthist);
+		//dense mode: windows of xgrid x ygrid cells of a CellMap, given by their top-left cell [cx cy].
+		//The descriptor equals extract() on [cx*cell, cy*cell, (cx + xgrid)*cell - 1, (cy + ygrid)*cell - 1]
+		//when the map was built with the same normalize flag; cells are gathered, not recomputed
+		void extract(ublas::matrix<float> &dscr_list, const ublas::matrix<int> &cell_list, const CellMap &cells);
+		//dense mode over every window whose top-left cell is on a multiple of stride, row by row;
+		//both matrices are resized, bbox_list receives the window boxes
+		void extract_dense(ublas::matrix<float> &dscr_list, ublas::matrix<int> &bbox_list, const CellMap &cells, int stride = 1);
+		//dense mode on L2-Hys normalized blocks: the descriptor of a window of xgrid x ygrid cells is
+		//its (xgrid - block + 1) x (ygrid - block + 1) blocks, x major, blocks.length() floats each
+		void extract(ublas::matrix<float> &dscr_list, const ublas::matrix<int> &cell_list, const BlockMap &blocks);
+		void extract_dense(ublas::matrix<float> &dscr_list, ublas::matrix<int> &bbox_list, const BlockMap &blocks, int stride = 1);
+
+		//grid lines splitting bbox [x0 y0 x1 y1], clamped to the image, into xgrid x ygrid cells:
+		//cell (i, j) is [xs[i], ys[j], xs[i+1] - 1, ys[j+1] - 1]; the lines are strictly
+		//increasing and inside the image, so they can go to get_window_hist_unchecked
+		template<typename InputIterator>
+		static inline void grid_lines(int *xs, int *ys, InputIterator bbox, int width, int height, int xgrid, int ygrid);
+
+		inline int length(int dirnum) const { return _param.xgrid * _param.ygrid * dirnum; }
+		//smallest stride >= length floats that keeps rows of a 64-byte aligned buffer aligned
+		static inline size_t aligned_stride(int length) { return (static_cast<size_t>(length) + 15) & ~static_cast<size_t>(15); }
 
 	private:
+		void extract_rows(float *dscr, size_t stride, const int32_t *bbox, size_t bbox_stride, int count, const IntegralHistogram &inthist);
+		void check_blocks(const BlockMap &blocks) const;
+		template<typename T>
+		void extract_quantized(T *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist);
+
 		Param _param;
 };
 
+//grid of a fixed window size, built once per (window size, grid, dirnum) and shared by all windows
+//of that size: the cell corners are kept as linear offsets into the integral histogram, so a
+//window at (x0, y0) costs a base offset. The cells are those of HOGExtractor::grid_lines for the
+//box [0 0 width-1 height-1], moved to (x0, y0)
+class ExtractionPlan
+{
+	public:
+		ExtractionPlan(const IntegralHistogram &inthist, int width, int height, int xgrid, int ygrid);
+		//plan windows of another size instead, in the same storage
+		void resize(int width, int height);
+
+		inline int width() const { return _width; }
+		inline int height() const { return _height; }
+		inline int length() const { return _xgrid * _ygrid * _dirnum; }
+		//the window [x0 y0 x0+width-1 y0+height-1] lies in the image
+		inline bool fits(int x0, int y0) const
+		{ return x0 >= 0 && y0 >= 0 && x0 + _width <= _image_width && y0 + _height <= _image_height; }
+		//descriptor of the window at (x0, y0), which has to fit
+		template<typename OutputIterator>
+		inline void extract(OutputIterator dscr, int x0, int y0, bool normalize = true) const;
+
+	private:
+		const IntegralHistogram *_inthist;
+		int _width;
+		int _height;
+		int _xgrid;
+		int _ygrid;
+		int _dirnum;
+		int _image_width;
+		int _image_height;
+		std::vector<int> _grid;    //xs then ys, relative to the window
+		std::vector<ptrdiff_t> _offsets;   //(xgrid + 1)*(ygrid + 1) corners, x major
+};
+
+//count descriptors of length floats in 64-byte aligned rows, for the float* HOGExtractor::extract
+class DescriptorBuffer : boost::noncopyable
+{
+	public:
+		DescriptorBuffer(int count, int length):_count(count),_stride(HOGExtractor::aligned_stride(length)),
+			_storage(static_cast<size_t>(count)*_stride + 16)
+		{
+			_offset = (64 - reinterpret_cast<size_t>(&_storage[0]) % 64) % 64 / sizeof(float);
+		}
+
+		inline float *data() { return &_storage[_offset]; }
+		inline const float *data() const { return &_storage[_offset]; }
+		inline float *row(int k) { return data() + k*_stride; }
+		inline const float *row(int k) const { return data() + k*_stride; }
+		inline size_t stride() const { return _stride; }
+		inline int count() const { return _count; }
+
+	private:
+		int _count;
+		size_t _stride;
+		std::vector<float> _storage;
+		size_t _offset;
+};
+
+//HOGExtractor for a compile-time bin count and grid, the grid and histograms are fully
+//unrolled and kept on the stack; the output is identical to HOGExtractor
+template<int Bins, int XGrid, int YGrid>
+class FixedHOGExtractor
+{
+	public:
+		static const int length = Bins * XGrid * YGrid;
+
+		template<typename OutputIterator, typename InputIterator>
+		static inline void extract(OutputIterator dscr, InputIterator bbox, const IntegralHistogram &inthist, bool normalize = true)
+		{
+			int xs[XGrid + 1], ys[YGrid + 1];
+			HOGExtractor::grid_lines(xs, ys, bbox, inthist.width(), inthist.height(), XGrid, YGrid);
+			inthist.get_window_hist_unchecked<Bins>(dscr, xs, XGrid, ys, YGrid, normalize);
+		}
+};
+
+template<typename InputIterator>
+inline void HOGExtractor::grid_lines(int *xs, int *ys, InputIterator bbox, int width, int height, int xgrid, int ygrid)
+{
+	int x0 = std::max( static_cast<int>(*bbox++), 0 );
+	int y0 = std::max( static_cast<int>(*bbox++), 0 );
+	int x1 = std::min( static_cast<int>(*bbox++), width - 1 );
+	int y1 = std::min( static_cast<int>(*bbox++), height - 1 );
+	if ( x1 - x0 < xgrid || y1 - y0 < ygrid )
+		throw std::runtime_error( boost::str(boost::format("Grid number should be less than bbox width/height [%1% %2% %3% %4%]/[%5% %6%]") % x0 % y0 % x1 % y1 % xgrid % ygrid) );
+
+	//cell i spans [x0 + xstep*i, x0 + xstep*(i + 1) - 1], so neighbouring cells share a line;
+	//the offset is rounded on its own so that the lines only depend on the box size, which is
+	//what lets ExtractionPlan reuse them at any x0, y0
+	float xstep = static_cast<float>(x1 - x0 + 1) / xgrid;
+	float ystep = static_cast<float>(y1 - y0 + 1) / ygrid;
+	for (int i = 0; i <= xgrid; ++i) xs[i] = x0 + static_cast<int>(xstep*i);
+	for (int j = 0; j <= ygrid; ++j) ys[j] = y0 + static_cast<int>(ystep*j);
+}
+
+template<typename OutputIterator>
+inline void ExtractionPlan::extract(OutputIterator dscr, int x0, int y0, bool normalize) const
+{
+	if (_dirnum == 8 && _inthist->padded())
+		return _inthist->get_planned_hist<8>(dscr, x0, y0, &_offsets[0], _xgrid, _ygrid, normalize);
+	if (_dirnum == 9 && _inthist->padded())
+		return _inthist->get_planned_hist<9>(dscr, x0, y0, &_offsets[0], _xgrid, _ygrid, normalize);
+
+	//other bin counts still skip grid_lines
+	int stack_grid[64];
+	std::vector<int> heap_grid;
+	int *xs = stack_grid;
+	if (_grid.size() > 64)
+	{
+		heap_grid.resize(_grid.size());
+		xs = &heap_grid[0];
+	}
+	int *ys = xs + _xgrid + 1;
+	for (int i = 0; i <= _xgrid; ++i) xs[i] = _grid[i] + x0;
+	for (int j = 0; j <= _ygrid; ++j) ys[j] = _grid[_xgrid + 1 + j] + y0;
+	_inthist->get_window_hist_unchecked(dscr, xs, _xgrid, ys, _ygrid, normalize);
+}
+
 #endif //HOG_EXTRACTOR_H
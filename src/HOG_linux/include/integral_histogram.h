@@ -35,13 +35,42 @@
 #define INTIGRAL_HISTOGRAM_H
 
 #include "image.h"
+#include "hist_simd.h"
+
+class OrientationBinning;
 
 #include <boost/detail/iterator.hpp>
 #include <boost/format.hpp>
 #include <stdexcept>
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+//Storage layouts of the integral histogram, selected at compile time through
+//BasicIntegralHistogram<Layout>. index() is the offset of (x, y, bin).
+struct InterleavedLayout
+{
+	//the bins of a pixel are adjacent, suits single window queries
+	static const bool planar = false;
+	static inline size_t index(int x, int y, int bin, int width, int height, int dirnum)
+	{ return (static_cast<size_t>(y)*width + x)*dirnum + bin; }
+	static inline size_t pixel_stride(int dirnum) { return dirnum; }
+	static inline size_t bin_stride(int width, int height) { return 1; }
+};
 
-class IntegralHistogram
+struct PlanarLayout
+{
+	//one contiguous plane per bin, suits dense scanning across x
+	static const bool planar = true;
+	static inline size_t index(int x, int y, int bin, int width, int height, int dirnum)
+	{ return (static_cast<size_t>(bin)*height + y)*width + x; }
+	static inline size_t pixel_stride(int dirnum) { return 1; }
+	static inline size_t bin_stride(int width, int height) { return static_cast<size_t>(width)*height; }
+};
+
+//parameters and the layout independent part of the gradient computation
+class IntegralHistogramBase
 {
 	public:
 		enum hist_type{undirected = 0, directed = 1};
@@ -51,34 +80,127 @@ class IntegralHistogram
 			int dirnum;
 			float exp; //weight factor, default 1;
 			float sigma;
-			Param(hist_type h = directed, int d = 8, float e = 1, float s = 0):htype(h),dirnum(d),exp(e),sigma(s){}
+			bool vector_binning; //bin by direction vectors instead of atan, see orientation_binning.h
+			int nthreads; //threads used by build, the result is identical for any value
+			bool streaming; //one pass over the image instead of full-frame gradient/magnitude images
+			bool zero_pad; //store a leading zero row and column, every query becomes a plain 4-corner difference
+			Param(hist_type h = directed, int d = 8, float e = 1, float s = 0, bool vb = true, int nt = 1, bool st = true, bool zp = true):htype(h),dirnum(d),exp(e),sigma(s),vector_binning(vb),nthreads(nt),streaming(st),zero_pad(zp){}
 		};
 
-		IntegralHistogram(hist_type htype = directed, int dirnum = 8, float exp = 1, float sigma = 0);
-		IntegralHistogram(Param &param);
-		~IntegralHistogram();
-		void build(Image &img);  //img will be modified
-
-		template<typename OutputIterator, typename InputIterator>
-		inline void get_hist(OutputIterator hist_begin, InputIterator bbox_begin, InputIterator bbox_endi, bool normalize = true) const;
-		inline const float *get_inthist(int x, int y){ return _inthist + (y*_width + x)*_param.dirnum; }
 		inline int dirnum() const { return _param.dirnum; }
 		inline int width() const { return _width; }
 		inline int height() const { return _height; }
-		IntegralHistogram &load( const char *fn );
-		IntegralHistogram &save( const char *fn );
 
-	private:
-		float *_inthist;
+	protected:
+		IntegralHistogramBase(const Param &param):_height(0),_width(0),_pad(0),_avx2(hist8_avx2_supported()),_param(param){}
+		void magnitude(float *mod, const float *h, const float *v, int n) const;
+		void bin(const OrientationBinning *binning, float *hist, const float *h, const float *v, const float *mod, int n) const;
+		OrientationBinning *new_binning() const;
+
 		int _height;
 		int _width;
-		static const float eps = 1e-10;
+		int _pad; //1 when the zero row/column is stored
+		bool _avx2; //8-bin queries go through hist_simd.h
+		static const float eps;
 		Param _param;
 };
 
+template<typename Layout = InterleavedLayout>
+class BasicIntegralHistogram : public IntegralHistogramBase
+{
+	public:
+		BasicIntegralHistogram(hist_type htype = directed, int dirnum = 8, float exp = 1, float sigma = 0);
+		BasicIntegralHistogram(Param &param);
+		~BasicIntegralHistogram();
+		void build(Image &img);  //img will be modified
+		//approximate build at another scale: the channels of src area-averaged to width x height
+		//and multiplied by gain, read off the integral of src without rebuilding from an image
+		void resample(const BasicIntegralHistogram &src, int width, int height, float gain = 1);
+
+		template<typename OutputIterator, typename InputIterator>
+		inline void get_hist(OutputIterator hist_begin, InputIterator bbox_begin, InputIterator bbox_endi, bool normalize = true) const;
+		//same as above for a compile-time bin count, which has to equal dirnum()
+		template<int Dirnum, typename OutputIterator, typename InputIterator>
+		inline void get_hist(OutputIterator hist_begin, InputIterator bbox_begin, InputIterator bbox_end, bool normalize = true) const;
+		//histograms of the xgrid x ygrid cells [xs[i], ys[j], xs[i+1] - 1, ys[j+1] - 1] of a window, x major;
+		//each of the (xgrid+1)*(ygrid+1) corner histograms is read once and shared by its cells
+		template<typename OutputIterator>
+		inline void get_window_hist(OutputIterator hist_begin, const int *xs, int xgrid, const int *ys, int ygrid, bool normalize = true) const
+		{ window_hist<0, true>(hist_begin, xs, xgrid, ys, ygrid, normalize); }
+		template<int Dirnum, typename OutputIterator>
+		inline void get_window_hist(OutputIterator hist_begin, const int *xs, int xgrid, const int *ys, int ygrid, bool normalize = true) const
+		{ window_hist<Dirnum, true>(hist_begin, xs, xgrid, ys, ygrid, normalize); }
+		//same as get_window_hist without validating the grid, for callers that clamp their windows
+		template<typename OutputIterator>
+		inline void get_window_hist_unchecked(OutputIterator hist_begin, const int *xs, int xgrid, const int *ys, int ygrid, bool normalize = true) const
+		{ window_hist<0, false>(hist_begin, xs, xgrid, ys, ygrid, normalize); }
+		template<int Dirnum, typename OutputIterator>
+		inline void get_window_hist_unchecked(OutputIterator hist_begin, const int *xs, int xgrid, const int *ys, int ygrid, bool normalize = true) const
+		{ window_hist<Dirnum, false>(hist_begin, xs, xgrid, ys, ygrid, normalize); }
+		//window cells from precomputed corner offsets: corner (i, j), x major, is at offsets[i*(ygrid + 1) + j]
+		//from the corner (x0 - 1, y0 - 1), see offset(); no checks, the corners have to be in the storage
+		template<int Dirnum, typename OutputIterator>
+		inline void get_planned_hist(OutputIterator hist_begin, int x0, int y0, const ptrdiff_t *offsets, int xgrid, int ygrid, bool normalize = true) const;
+		//storage distance of the pixel (x + dx, y + dy) from (x, y)
+		inline ptrdiff_t offset(int dx, int dy) const { return static_cast<ptrdiff_t>(index(dx, dy, 0)) - static_cast<ptrdiff_t>(index(0, 0, 0)); }
+		//the zero row above and column left of the image are stored, see Param::zero_pad
+		inline bool padded() const { return _pad != 0; }
+		void get_hist_row(float *hist, int x0, int y0, int x1, int y1, int count) const;
+		//bins of the returned pixel are bin_stride() apart
+		inline const float *get_inthist(int x, int y) const { return _inthist + index(x, y, 0); }
+		inline size_t bin_stride() const { return Layout::bin_stride(_width + _pad, _height + _pad); }
+		BasicIntegralHistogram &load( const char *fn );
+		BasicIntegralHistogram &save( const char *fn );
+
+	private:
+		//offset of (x, y, bin), x and y may be -1 when padded
+		inline size_t index(int x, int y, int bin) const
+		{ return Layout::index(x + _pad, y + _pad, bin, _width + _pad, _height + _pad, _param.dirnum); }
+		//sum of bin over the pixels [0, x) x [0, y), 0 <= x <= width, 0 <= y <= height
+		inline float integral(int x, int y, int bin) const
+		{ return !_pad && (x == 0 || y == 0) ? 0 : _inthist[index(x - 1, y - 1, bin)]; }
+		//the AVX2 kernels need the 8 bins of a corner adjacent and every corner inside the storage
+		inline bool simd8() const { return _avx2 && !Layout::planar && _pad; }
+		template<int Dirnum>
+		inline const float *corner(int x, int y) const
+		{ return _inthist + Layout::index(x + _pad, y + _pad, 0, _width + _pad, _height + _pad, Dirnum > 0 ? Dirnum : _param.dirnum); }
+		template<int Dirnum, bool Checked, typename OutputIterator>
+		inline void window_hist(OutputIterator hist_begin, const int *xs, int xgrid, const int *ys, int ygrid, bool normalize) const;
+		inline void load_corners(float *corners, int x, const int *ys, int ygrid, int dirnum) const;
+		//ygrid 8-bin cells of a window column through the AVX2 kernel, written straight into float
+		//buffers and through scratch otherwise
+		template<typename OutputIterator>
+		static inline void column8(OutputIterator &hist_begin, float *scratch, const float *left, const float *right, int ygrid, bool normalize)
+		{
+			hist8_column_avx2(scratch, left, right, ygrid, normalize, eps);
+			for (int k = 0; k < ygrid*8; ++k, ++hist_begin) *hist_begin = scratch[k];
+		}
+		static inline void column8(float *&hist_begin, float *, const float *left, const float *right, int ygrid, bool normalize)
+		{
+			hist8_column_avx2(hist_begin, left, right, ygrid, normalize, eps);
+			hist_begin += ygrid*8;
+		}
+		void allocate();
+		void store_row(int i, const float *hist, bool prefix, bool accumulate);
+		void build_rows(const Image &img, const OrientationBinning *binning, int row_begin, int row_end, bool accumulate);
+		void integrate();
+		void integrate_rows(int row_begin, int row_end);
+		void integrate_columns(int col_begin, int col_end);
+		void resample_rows(const BasicIntegralHistogram *src, float gain, int row_begin, int row_end);
+
+		float *_inthist;
+};
+
+typedef BasicIntegralHistogram<InterleavedLayout> IntegralHistogram;
+typedef BasicIntegralHistogram<PlanarLayout> PlanarIntegralHistogram;
+
+template<typename Layout>
 template<typename OutputIterator, typename InputIterator>
-inline void IntegralHistogram::get_hist(OutputIterator hist_begin, InputIterator bbox_begin, InputIterator bbox_end, bool normalize) const
+inline void BasicIntegralHistogram<Layout>::get_hist(OutputIterator hist_begin, InputIterator bbox_begin, InputIterator bbox_end, bool normalize) const
 {
+	if (_param.dirnum == 8 && simd8())
+		return get_hist<8>(hist_begin, bbox_begin, bbox_end, normalize);
+
 	typedef typename boost::detail::iterator_traits<InputIterator>::reference reference;
 	while( bbox_begin != bbox_end )
 	{
@@ -92,15 +214,26 @@ inline void IntegralHistogram::get_hist(OutputIterator hist_begin, InputIterator
 
 		float sum = 0;
 		OutputIterator hist = hist_begin;
-		for (int i = 0; i < _param.dirnum; ++i, ++hist_begin)
+		if (_pad)
 		{
-			*hist_begin = _inthist[(y1*_width + x1)*_param.dirnum + i];
+			const size_t bs = bin_stride();
+			const float *p11 = _inthist + index(x1, y1, 0), *p01 = _inthist + index(x0 - 1, y1, 0);
+			const float *p10 = _inthist + index(x1, y0 - 1, 0), *p00 = _inthist + index(x0 - 1, y0 - 1, 0);
+			for (int i = 0; i < _param.dirnum; ++i, ++hist_begin)
+			{
+				*hist_begin = p11[i*bs] - p01[i*bs] - p10[i*bs] + p00[i*bs];
+				sum += *hist_begin;
+			}
+		}
+		else for (int i = 0; i < _param.dirnum; ++i, ++hist_begin)
+		{
+			*hist_begin = _inthist[index(x1, y1, i)];
 			if( x0 > 0 )
-				*hist_begin -= _inthist[(y1*_width + x0 - 1)*_param.dirnum + i];
+				*hist_begin -= _inthist[index(x0 - 1, y1, i)];
 			if( y0 > 0 )
-				*hist_begin -= _inthist[( (y0-1)*_width + x1 )*_param.dirnum + i];
+				*hist_begin -= _inthist[index(x1, y0 - 1, i)];
 			if( x0 >0 && y0 >0 )
-				*hist_begin += _inthist[( (y0-1)*_width + x0 - 1 )*_param.dirnum + i];
+				*hist_begin += _inthist[index(x0 - 1, y0 - 1, i)];
 
 			if( normalize )
 				sum += *hist_begin;
@@ -111,4 +244,168 @@ inline void IntegralHistogram::get_hist(OutputIterator hist_begin, InputIterator
 		}
 	}
 }
+
+template<typename Layout>
+template<int Dirnum, typename OutputIterator, typename InputIterator>
+inline void BasicIntegralHistogram<Layout>::get_hist(OutputIterator hist_begin, InputIterator bbox_begin, InputIterator bbox_end, bool normalize) const
+{
+	while( bbox_begin != bbox_end )
+	{
+		int x0 = *bbox_begin++;
+		int y0 = *bbox_begin++;
+		int x1 = *bbox_begin++;
+		int y1 = *bbox_begin++;
+
+		if ( x0 < 0 || y0 < 0 || x0 > x1 || y0 > y1 || x1 >= _width || y1 >= _height)
+			throw std::runtime_error( boost::str(boost::format("Invalid index [%1% %2% %3% %4%]") % x0 % y0 % x1 % y1) );
+
+		const size_t bs = bin_stride();
+		float hist[Dirnum];
+		if (Dirnum == 8 && simd8())
+		{
+			hist8_avx2(hist, corner<Dirnum>(x1, y1), corner<Dirnum>(x0 - 1, y1), corner<Dirnum>(x1, y0 - 1), corner<Dirnum>(x0 - 1, y0 - 1), normalize, eps);
+			for (int i = 0; i < Dirnum; ++i, ++hist_begin) *hist_begin = hist[i];
+			continue;
+		}
+		if (_pad)
+		{
+			const float *p11 = corner<Dirnum>(x1, y1), *p01 = corner<Dirnum>(x0 - 1, y1);
+			const float *p10 = corner<Dirnum>(x1, y0 - 1), *p00 = corner<Dirnum>(x0 - 1, y0 - 1);
+			for (int i = 0; i < Dirnum; ++i) hist[i] = p11[i*bs] - p01[i*bs] - p10[i*bs] + p00[i*bs];
+		}
+		else
+		{
+			for (int i = 0; i < Dirnum; ++i) hist[i] = corner<Dirnum>(x1, y1)[i*bs];
+			if( x0 > 0 )
+				for (int i = 0; i < Dirnum; ++i) hist[i] -= corner<Dirnum>(x0 - 1, y1)[i*bs];
+			if( y0 > 0 )
+				for (int i = 0; i < Dirnum; ++i) hist[i] -= corner<Dirnum>(x1, y0 - 1)[i*bs];
+			if( x0 >0 && y0 >0 )
+				for (int i = 0; i < Dirnum; ++i) hist[i] += corner<Dirnum>(x0 - 1, y0 - 1)[i*bs];
+		}
+
+		if (normalize)
+		{
+			float sum = 0;
+			for (int i = 0; i < Dirnum; ++i) sum += hist[i];
+			for (int i = 0; i < Dirnum; ++i) hist[i] /= (sum + eps);
+		}
+		for (int i = 0; i < Dirnum; ++i, ++hist_begin) *hist_begin = hist[i];
+	}
+}
+
+//corner histograms at (x, ys[j] - 1), j = 0..ygrid, zero outside the image
+template<typename Layout>
+inline void BasicIntegralHistogram<Layout>::load_corners(float *corners, int x, const int *ys, int ygrid, int dirnum) const
+{
+	const size_t bs = bin_stride();
+	for (int j = 0; j <= ygrid; ++j, corners += dirnum)
+	{
+		if (!_pad && (x < 0 || ys[j] < 1))
+		{
+			for (int i = 0; i < dirnum; ++i) corners[i] = 0;
+			continue;
+		}
+		const float *corner = _inthist + index(x, ys[j] - 1, 0);
+		for (int i = 0; i < dirnum; ++i) corners[i] = corner[i*bs];
+	}
+}
+
+//Dirnum == 0 uses the runtime bin count. The grid lines are walked in x, keeping the corners
+//of the previous and the current line; the arithmetic matches get_hist
+template<typename Layout>
+template<int Dirnum, bool Checked, typename OutputIterator>
+inline void BasicIntegralHistogram<Layout>::window_hist(OutputIterator hist_begin, const int *xs, int xgrid, const int *ys, int ygrid, bool normalize) const
+{
+	const int dirnum = Dirnum > 0 ? Dirnum : _param.dirnum;
+	if (Checked)
+	{
+		for (int i = 0; i < xgrid; ++i)
+			if ( xs[i] < 0 || xs[i] >= xs[i + 1] || xs[xgrid] > _width )
+				throw std::runtime_error( boost::str(boost::format("Invalid x grid [%1% %2%]") % xs[i] % xs[i + 1]) );
+		for (int j = 0; j < ygrid; ++j)
+			if ( ys[j] < 0 || ys[j] >= ys[j + 1] || ys[ygrid] > _height )
+				throw std::runtime_error( boost::str(boost::format("Invalid y grid [%1% %2%]") % ys[j] % ys[j + 1]) );
+	}
+
+	//the kernel gathers a whole column of cells before they are written out
+	const bool simd = dirnum == 8 && _avx2;
+	const int size = (2*(ygrid + 1) + (simd ? ygrid : 1))*dirnum;
+	float stack_buf[1024];
+	std::vector<float> heap_buf;
+	float *left = stack_buf;
+	if (size > 1024)
+	{
+		heap_buf.resize(size);
+		left = &heap_buf[0];
+	}
+	float *right = left + (ygrid + 1)*dirnum;
+	float *hist = right + (ygrid + 1)*dirnum;
+
+	load_corners(left, xs[0] - 1, ys, ygrid, dirnum);
+	for (int i = 0; i < xgrid; ++i)
+	{
+		load_corners(right, xs[i + 1] - 1, ys, ygrid, dirnum);
+		if (simd)
+		{
+			column8(hist_begin, hist, left, right, ygrid, normalize);
+			std::swap(left, right);
+			continue;
+		}
+		for (int j = 0; j < ygrid; ++j)
+		{
+			const float *p00 = left + j*dirnum, *p01 = p00 + dirnum;
+			const float *p10 = right + j*dirnum, *p11 = p10 + dirnum;
+			for (int k = 0; k < dirnum; ++k)
+			{
+				hist[k] = p11[k];
+				hist[k] -= p01[k];
+				hist[k] -= p10[k];
+				hist[k] += p00[k];
+			}
+			if (normalize)
+			{
+				float sum = 0;
+				for (int k = 0; k < dirnum; ++k) sum += hist[k];
+				for (int k = 0; k < dirnum; ++k) hist[k] /= (sum + eps);
+			}
+			for (int k = 0; k < dirnum; ++k, ++hist_begin) *hist_begin = hist[k];
+		}
+		std::swap(left, right);
+	}
+}
+template<typename Layout>
+template<int Dirnum, typename OutputIterator>
+inline void BasicIntegralHistogram<Layout>::get_planned_hist(OutputIterator hist_begin, int x0, int y0, const ptrdiff_t *offsets, int xgrid, int ygrid, bool normalize) const
+{
+	const float *base = _inthist + index(x0 - 1, y0 - 1, 0);
+	const size_t bs = bin_stride();
+	const int lines = ygrid + 1;
+	float hist[Dirnum];
+	for (int i = 0; i < xgrid; ++i)
+		for (int j = 0; j < ygrid; ++j)
+		{
+			const float *p00 = base + offsets[i*lines + j], *p01 = base + offsets[i*lines + j + 1];
+			const float *p10 = base + offsets[(i + 1)*lines + j], *p11 = base + offsets[(i + 1)*lines + j + 1];
+			if (Dirnum == 8 && simd8())
+				hist8_avx2(hist, p11, p01, p10, p00, normalize, eps);
+			else
+			{
+				for (int k = 0; k < Dirnum; ++k)
+				{
+					hist[k] = p11[k*bs];
+					hist[k] -= p01[k*bs];
+					hist[k] -= p10[k*bs];
+					hist[k] += p00[k*bs];
+				}
+				if (normalize)
+				{
+					float sum = 0;
+					for (int k = 0; k < Dirnum; ++k) sum += hist[k];
+					for (int k = 0; k < Dirnum; ++k) hist[k] /= (sum + eps);
+				}
+			}
+			for (int k = 0; k < Dirnum; ++k, ++hist_begin) *hist_begin = hist[k];
+		}
+}
 #endif //INTIGRAL_HISTOGRAM_H
@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Non-maximum suppression of scored boxes, greedy or soft, with the boxes bucketed
+//              in a uniform grid so that each overlap test only visits the boxes of the cells a
+//              box touches.
+//
+// Reference
+// N. Bodla, B. Singh, R. Chellappa and L. S. Davis, "Soft-NMS -- improving object detection with
+// one line of code", ICCV 2017.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef NMS_H
+#define NMS_H
+
+#include <vector>
+#include <stdint.h>
+
+class NonMaxSuppression
+{
+	public:
+		enum nms_type
+		{
+			greedy,     //drop every box overlapping a kept one by more than overlap
+			linear,     //soft: score *= 1 - IoU above overlap
+			gaussian    //soft: score *= exp(-IoU^2 / sigma) for every overlapping box
+		};
+
+		struct Param
+		{
+			nms_type type;
+			float overlap;     //IoU threshold of greedy and linear
+			float sigma;       //gaussian decay
+			float min_score;   //soft: boxes decayed below are dropped
+			int cell;          //grid cell in pixels, 0 for the mean box side
+			Param(nms_type t = greedy, float o = 0.5f, float s = 0.5f, float ms = 0.001f, int c = 0):type(t),overlap(o),sigma(s),min_score(ms),cell(c){}
+		};
+
+		NonMaxSuppression(Param &param):_param(param){}
+
+		//count boxes [x0 y0 x1 y1] (inclusive, as HOGExtractor::extract and FeaturePyramid::image_box)
+		//of a flat array with their scores. keep gets the indices of the boxes kept in decreasing order
+		//of their final score, kept_scores the scores (decayed by soft NMS). Returns keep.size()
+		int suppress(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, int count);
+		//batch of images: the boxes of image i are [begin[i], begin[i + 1]) of the flat arrays and are
+		//suppressed among themselves; keep gets global indices, image after image
+		int suppress(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, const int *begin, int images);
+
+		static float iou(const int32_t *a, const int32_t *b);
+
+	private:
+		void build_grid(const int32_t *boxes, int count);
+		//cells [c0, c1] x [r0, r1] a box touches
+		void cells(int &c0, int &r0, int &c1, int &r1, const int32_t *box) const;
+		void insert(const int32_t *boxes, int k);
+		void suppress_greedy(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, int count);
+		void suppress_soft(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, int count);
+
+		Param _param;
+		int _x0;
+		int _y0;
+		int _cell;
+		int _cols;
+		int _rows;
+		std::vector<std::vector<int> > _buckets;   //box indices per cell, x major
+		std::vector<int> _stamp;                   //last query that visited a box, a box spans several cells
+		std::vector<int> _order;
+};
+
+#endif //NMS_H
@@ -0,0 +1,51 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Soft two-bin orientation binning of image gradients without transcendental calls.
+//
+// The bin of a gradient is found by comparing it against precomputed bin direction vectors
+// and the offset inside the bin is taken from a polynomial arctangent on [0, 1]
+// (Abramowitz & Stegun 4.4.49, |error| <= 2e-8 rad). Compared with the atan2/atan path of
+// IntegralHistogram::build the two bin weights of a pixel agree within 1e-5 * magnitude.
+//
+// Only configurations whose bin width is at most pi/4 are supported, i.e. dirnum >= 8 for
+// directed and dirnum >= 4 for undirected histograms; see supported(). bin runs an AVX2 kernel
+// when the CPU has it (HOG_NO_AVX2 forces the SSE2 one) and the scalar code on the tail.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ORIENTATION_BINNING_H
+#define ORIENTATION_BINNING_H
+
+#include <vector>
+
+class OrientationBinning
+{
+	public:
+		OrientationBinning(bool directed, int dirnum);
+		static bool supported(bool directed, int dirnum);
+
+		//hist receives n*dirnum interleaved weights; h, v are the [-1 0 1] responses
+		//computed by IntegralHistogram::build and mod the gradient magnitudes
+		void bin(float *hist, const float *h, const float *v, const float *mod, int n) const;
+
+	private:
+		void bin_scalar(float *hist, const float *h, const float *v, const float *mod, int n) const;
+		//one vector kernel over lanes of V::VLEN floats, instantiated with 8 lanes by bin_avx2, which
+		//is compiled for AVX2 and only called when hist8_avx2_supported(), and with 4 by bin_sse2
+		template<typename V>
+		int bin_lanes(float *hist, const float *h, const float *v, const float *mod, int n) const;
+		int bin_avx2(float *hist, const float *h, const float *v, const float *mod, int n) const;
+		int bin_sse2(float *hist, const float *h, const float *v, const float *mod, int n) const;
+		void scatter(float *hist, const int *bin_l, const float *w_l, const float *w_r, int n) const;
+
+		bool _directed;
+		int _dirnum;
+		int _ndirs;   //number of direction vectors, dirnum (+1 for undirected)
+		float _theta;
+		std::vector<float> _cos;   //cos/sin of direction k
+		std::vector<float> _sin;
+		std::vector<float> _cos_prev;   //cos/sin of direction k - 1
+		std::vector<float> _sin_prev;
+		std::vector<int> _left;    //bins receiving the two weights when the left direction is k, indexed by k + 1
+		std::vector<int> _right;
+};
+
+#endif //ORIENTATION_BINNING_H
@@ -0,0 +1,222 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Minimal fork/join helpers used by the multi-threaded code paths.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <algorithm>
+
+namespace parallel_detail
+{
+	//first error raised by a worker, rethrown on the calling thread once all workers are done
+	struct WorkError
+	{
+		boost::exception_ptr first;
+		boost::mutex lock;
+	};
+
+	//must be called from inside a catch block
+	inline void fail(WorkError *error)
+	{
+		boost::mutex::scoped_lock guard(error->lock);
+		if (!error->first)
+			error->first = boost::current_exception();
+	}
+
+	inline void rethrow(const WorkError &error)
+	{
+		if (error.first)
+			boost::rethrow_exception(error.first);
+	}
+
+	//func(begin, end) on its own copy of func, errors go to error
+	template<typename Func>
+	struct RangeWorker
+	{
+		int begin;
+		int end;
+		WorkError *error;
+		Func func;
+		RangeWorker(int b, int e, WorkError *err, const Func &f):begin(b),end(e),error(err),func(f){}
+		void operator()()
+		{
+			try
+			{
+				func(begin, end);
+			}
+			catch (...)
+			{
+				fail(error);
+			}
+		}
+	};
+}
+
+//split [begin, end) into nthreads contiguous ranges and call func(range_begin, range_end) for
+//each of them, the first range runs on the calling thread. The first exception thrown by func is
+//rethrown with its original type after all threads have finished
+template<typename Func>
+void parallel_for(int begin, int end, int nthreads, Func func)
+{
+	int count = end - begin;
+	nthreads = std::min(nthreads, count);
+	if (nthreads <= 1)
+	{
+		if (count > 0) func(begin, end);
+		return;
+	}
+
+	parallel_detail::WorkError error;
+	boost::thread_group threads;
+	try
+	{
+		for (int t = 1; t < nthreads; ++t)
+			threads.create_thread( parallel_detail::RangeWorker<Func>(begin + count*t/nthreads, begin + count*(t + 1)/nthreads, &error, func) );
+	}
+	catch (...)
+	{
+		//a thread could not be started, the started ones use this stack frame
+		threads.join_all();
+		throw;
+	}
+	parallel_detail::RangeWorker<Func>(begin, begin + count/nthreads, &error, func)();
+	threads.join_all();
+	parallel_detail::rethrow(error);
+}
+
+namespace parallel_detail
+{
+	//the items [next, end) still owned by a thread
+	struct WorkRange
+	{
+		int next;
+		int end;
+		boost::mutex lock;
+	};
+
+	//take up to grain items from the front of range, false when it is empty
+	inline bool take(WorkRange &range, int grain, int &b, int &e)
+	{
+		boost::mutex::scoped_lock guard(range.lock);
+		if (range.next >= range.end)
+			return false;
+		b = range.next;
+		e = std::min(range.next + grain, range.end);
+		range.next = e;
+		return true;
+	}
+
+	//move the back half of the fullest other range to ranges[self], false when all are empty
+	inline bool steal(WorkRange *ranges, int nranges, int self)
+	{
+		for (;;)
+		{
+			int victim = -1, most = 0;
+			for (int t = 0; t < nranges; ++t)
+			{
+				if (t == self)
+					continue;
+				boost::mutex::scoped_lock guard(ranges[t].lock);
+				if (ranges[t].end - ranges[t].next > most)
+				{
+					most = ranges[t].end - ranges[t].next;
+					victim = t;
+				}
+			}
+			if (victim < 0)
+				return false;
+
+			int b, e;
+			{
+				boost::mutex::scoped_lock guard(ranges[victim].lock);
+				int left = ranges[victim].end - ranges[victim].next;
+				if (left <= 0)
+					continue;   //emptied in the meantime, look again
+				b = ranges[victim].next + left/2;
+				e = ranges[victim].end;
+				ranges[victim].end = b;
+			}
+			boost::mutex::scoped_lock guard(ranges[self].lock);
+			ranges[self].next = b;
+			ranges[self].end = e;
+			return true;
+		}
+	}
+
+	//each thread works on its own copy of func, so functors can carry per-thread scratch
+	template<typename Func>
+	struct StealingWorker
+	{
+		WorkRange *ranges;
+		int nranges;
+		int self;
+		int grain;
+		WorkError *error;
+		Func func;
+		StealingWorker(WorkRange *r, int n, int s, int g, WorkError *err, const Func &f):ranges(r),nranges(n),self(s),grain(g),error(err),func(f){}
+		void operator()()
+		{
+			try
+			{
+				int b = 0, e = 0;
+				do
+				{
+					while (take(ranges[self], grain, b, e)) func(b, e);
+				} while (steal(ranges, nranges, self));
+			}
+			catch (...)
+			{
+				fail(error);
+			}
+		}
+	};
+}
+
+//work-stealing parallel_for for items of uneven cost: every thread starts on its own contiguous
+//range and calls func(chunk_begin, chunk_end) on chunks of at most grain items from its front;
+//a thread that runs dry steals the back half of the fullest remaining range. The first exception
+//thrown by func is rethrown with its original type after all threads have finished
+template<typename Func>
+void parallel_for_stealing(int begin, int end, int grain, int nthreads, Func func)
+{
+	int count = end - begin;
+	grain = std::max(grain, 1);
+	nthreads = std::min(nthreads, (count + grain - 1) / grain);
+	if (nthreads <= 1)
+	{
+		for (int b = begin; b < end; b += grain) func(b, std::min(b + grain, end));
+		return;
+	}
+
+	boost::scoped_array<parallel_detail::WorkRange> ranges(new parallel_detail::WorkRange[nthreads]);
+	for (int t = 0; t < nthreads; ++t)
+	{
+		ranges[t].next = begin + count*t/nthreads;
+		ranges[t].end = begin + count*(t + 1)/nthreads;
+	}
+
+	parallel_detail::WorkError error;
+	boost::thread_group threads;
+	try
+	{
+		for (int t = 1; t < nthreads; ++t)
+			threads.create_thread( parallel_detail::StealingWorker<Func>(ranges.get(), nthreads, t, grain, &error, func) );
+	}
+	catch (...)
+	{
+		//a thread could not be started, the started ones use this stack frame
+		threads.join_all();
+		throw;
+	}
+	parallel_detail::StealingWorker<Func>(ranges.get(), nthreads, 0, grain, &error, func)();
+	threads.join_all();
+	parallel_detail::rethrow(error);
+}
+
+#endif //PARALLEL_H
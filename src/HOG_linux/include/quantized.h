@@ -0,0 +1,37 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: 8-bit and half precision descriptor storage and the dot products used to score
+//              quantized descriptors.
+//
+// L1 normalized cell histograms lie in [0, 1] and are stored as q = round(255*v), 4x smaller
+// than float at an error of at most 1/510 per component. Half precision keeps 11 significant
+// bits for any range (values above 65504 become inf). The kernels use AVX2/F16C when the CPU
+// has them and HOG_NO_AVX2 is not set; integer results are exact either way, float results may
+// differ from the scalar loops in the last bits because of the summation order.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef QUANTIZED_H
+#define QUANTIZED_H
+
+#include <cstddef>
+#include <stdint.h>
+
+//q = round(255*v), clamped to [0, 255]
+void quantize_u8(uint8_t *q, const float *v, int n);
+//v = q/255
+void dequantize_u8(float *v, const uint8_t *q, int n);
+//IEEE half precision, round to nearest even
+void float_to_half(uint16_t *h, const float *v, int n);
+void half_to_float(float *v, const uint16_t *h, int n);
+
+//w . (q/255), a float model against an 8-bit descriptor
+float dot_u8(const float *w, const uint8_t *q, int n);
+//a . b of two 8-bit descriptors, exact; divide by 255^2 for descriptor units
+uint32_t dot_u8u8(const uint8_t *a, const uint8_t *b, int n);
+//w . h, a float model against a half precision descriptor
+float dot_f16(const float *w, const uint16_t *h, int n);
+
+//scores[k] = w . dscr_k + bias for count descriptors of n components, dscr + k*stride
+void score_u8(float *scores, const float *w, float bias, const uint8_t *dscr, size_t stride, int count, int n);
+void score_f16(float *scores, const float *w, float bias, const uint16_t *dscr, size_t stride, int count, int n);
+
+#endif //QUANTIZED_H
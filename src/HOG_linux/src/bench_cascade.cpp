@@ -0,0 +1,388 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Calibrates the stage thresholds of a soft cascade on a list of positive crops such
+//              as the INRIA positives and compares it with full evaluation: windows per second
+//              on background images and recall on held-out positives. The detections of the full
+//              model go through non-maximum suppression, checked against the all-pairs greedy one.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cfloat>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/time.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/format.hpp>
+#include <stdexcept>
+
+#include "cascade.h"
+#include "detector.h"
+#include "nms.h"
+
+void help_exit(const char *app_name)
+{
+	std::cout << "usage: " << app_name << " [options] \n"
+		<< "\t-r \t data root, default ../../inria\n"
+		<< "\t-l \t positive list under the root, default Train/pos.lst\n"
+		<< "\t-g \t background list under the root, default Train/neg.lst\n"
+		<< "\t-n \t number of images per list, default 100\n"
+		<< "\t-w \t model file: xgrid ygrid unit in blocks, bias, weights; default the mean difference of positives and background\n"
+		<< "\t-T \t detection threshold of the full model, default 0\n"
+		<< "\t-m \t miss rate per stage during calibration, default 0\n"
+		<< "\t-c \t cell size, default 8\n"
+		<< "\t-x \t window width in cells, default 8\n"
+		<< "\t-y \t window height in cells, default 16\n"
+		<< "\t-o \t save the calibrated cascade\n"
+		<< "\t-h \t display this message\n";
+	exit(1);
+}
+
+double now()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+std::vector<std::string> read_list(const std::string &root, const std::string &list, int count)
+{
+	std::vector<std::string> files;
+	std::ifstream ins((root + "/" + list).c_str());
+	std::string line;
+	while (static_cast<int>(files.size()) < count && std::getline(ins, line))
+		if (!line.empty())
+			files.push_back(root + "/" + line);
+	return files;
+}
+
+//2x2 block maps of the images of a list that load; the blocks are L2-Hys normalized, the cells
+//are not: a normalized cell of a flat area is float noise divided by noise
+void build_maps(std::vector<BlockMap> &maps, const std::vector<std::string> &files, int cell, const IntegralHistogram::Param &inthist_param)
+{
+	IntegralHistogram::Param param(inthist_param);
+	IntegralHistogram inthist(param);
+	CellMap cells;
+	for (unsigned int f = 0; f < files.size(); ++f)
+	{
+		Image im;
+		try
+		{
+			im.load(files[f].c_str());
+		}
+		catch (CImgException &)
+		{
+			std::cerr << "can not load " << files[f] << "\n";
+			continue;
+		}
+		inthist.build(im);
+		cells.build(inthist, cell, false);
+		maps.push_back(BlockMap());
+		maps.back().build(cells);
+	}
+}
+
+//descriptor of the window at block (bx, by) in the descriptor order of HOGExtractor
+void gather(float *dscr, const BlockMap &blocks, int bx, int by, int xgrid, int ygrid)
+{
+	for (int i = 0; i < xgrid; ++i)
+		for (int j = 0; j < ygrid; ++j)
+		{
+			const float *hist = blocks.hist(bx + i, by + j);
+			std::copy(hist, hist + blocks.length(), dscr + (i*ygrid + j)*blocks.length());
+		}
+}
+
+//every window of a map, top-left blocks
+void dense_windows(std::vector<int32_t> &windows, const BlockMap &blocks, int xgrid, int ygrid)
+{
+	windows.clear();
+	for (int cx = 0; cx + xgrid <= blocks.cols(); ++cx)
+		for (int cy = 0; cy + ygrid <= blocks.rows(); ++cy)
+		{
+			windows.push_back(cx);
+			windows.push_back(cy);
+		}
+}
+
+void load_model(const char *fn, std::vector<float> &weights, float &bias, int xgrid, int ygrid, int unit)
+{
+	std::ifstream fin(fn);
+	if (!fin.good())
+		throw std::runtime_error( boost::str(boost::format("Failed to open %1%") % fn ) );
+	int xg = 0, yg = 0, u = 0;
+	fin >> xg >> yg >> u >> bias;
+	if (xg != xgrid || yg != ygrid || u != unit)
+		throw std::runtime_error( boost::str(boost::format("%1% is a %2%x%3%x%4% model") % fn % xg % yg % u) );
+	weights.resize(static_cast<size_t>(xgrid)*ygrid*unit);
+	for (unsigned int k = 0; k < weights.size(); ++k)
+		fin >> weights[k];
+	if (!fin)
+		throw std::runtime_error( boost::str(boost::format("Failed to read the weights of %1%") % fn ) );
+}
+
+//greedy NMS of the boxes [begin, end) by testing every kept box, global indices
+void greedy_reference(std::vector<int> &keep, const std::vector<int32_t> &boxes, const std::vector<float> &scores, int begin, int end, float overlap)
+{
+	std::vector<std::pair<float, int> > order;
+	for (int k = begin; k < end; ++k) order.push_back(std::make_pair(-scores[k], k));
+	std::sort(order.begin(), order.end());
+	const size_t first = keep.size();
+	for (unsigned int n = 0; n < order.size(); ++n)
+	{
+		const int k = order[n].second;
+		bool suppressed = false;
+		for (size_t m = first; m < keep.size() && !suppressed; ++m)
+			suppressed = NonMaxSuppression::iou(&boxes[4*k], &boxes[4*keep[m]]) > overlap;
+		if (!suppressed)
+			keep.push_back(k);
+	}
+}
+
+struct Throughput
+{
+	double seconds;
+	double windows;
+	double stages;
+	double accepted;
+	Throughput():seconds(0),windows(0),stages(0),accepted(0){}
+};
+
+int main( int argc, char *argv[] )
+{
+	std::string root = "../../inria", pos_list = "Train/pos.lst", bg_list = "Train/neg.lst";
+	const char *model = 0, *fout = 0;
+	int nimages = 100, cell = 8, xgrid = 8, ygrid = 16;
+	float threshold = 0, miss_rate = 0;
+
+	int c;
+	while ((c = getopt(argc, argv, "r:l:g:n:w:T:m:c:x:y:o:h")) != -1)
+	{
+		switch (c)
+		{
+		case 'r':
+			root = optarg;
+			break;
+		case 'l':
+			pos_list = optarg;
+			break;
+		case 'g':
+			bg_list = optarg;
+			break;
+		case 'n':
+			nimages = boost::lexical_cast<int>(optarg);
+			break;
+		case 'w':
+			model = optarg;
+			break;
+		case 'T':
+			threshold = boost::lexical_cast<float>(optarg);
+			break;
+		case 'm':
+			miss_rate = boost::lexical_cast<float>(optarg);
+			break;
+		case 'c':
+			cell = boost::lexical_cast<int>(optarg);
+			break;
+		case 'x':
+			xgrid = boost::lexical_cast<int>(optarg);
+			break;
+		case 'y':
+			ygrid = boost::lexical_cast<int>(optarg);
+			break;
+		case 'o':
+			fout = optarg;
+			break;
+		case 'h':
+		case '?':
+		default:
+			help_exit(argv[0]);
+			break;
+		}
+	}
+
+	cimg::exception_mode() = 0;
+	IntegralHistogram::Param inthist_param;
+	std::vector<BlockMap> pos_maps, bg_maps;
+	build_maps(pos_maps, read_list(root, pos_list, nimages), cell, inthist_param);
+	build_maps(bg_maps, read_list(root, bg_list, nimages), cell, inthist_param);
+	if (pos_maps.empty())
+	{
+		std::cerr << "no positive image could be loaded\n";
+		return 1;
+	}
+	//without background images the positive images are scanned densely, most of their windows miss the person too
+	if (bg_maps.empty())
+	{
+		std::cerr << "no background image could be loaded, scanning the positive images\n";
+		bg_maps = pos_maps;
+	}
+
+	//positives: the centered window of each crop (block (2, 2) of the 96x160 INRIA crops); even
+	//crops calibrate, odd crops measure the recall. A window of xgrid x ygrid cells has one block less
+	//per side
+	xgrid -= 1;
+	ygrid -= 1;
+	const int unit = pos_maps[0].length(), length = xgrid*ygrid*unit;
+	std::vector<float> calibration, test;
+	for (unsigned int k = 0; k < pos_maps.size(); ++k)
+	{
+		const BlockMap &blocks = pos_maps[k];
+		if (blocks.cols() < xgrid || blocks.rows() < ygrid)
+			continue;
+		std::vector<float> &set = k % 2 == 0 ? calibration : test;
+		set.resize(set.size() + length);
+		gather(&set[set.size() - length], blocks, (blocks.cols() - xgrid) / 2, (blocks.rows() - ygrid) / 2, xgrid, ygrid);
+	}
+	const int ncalibration = static_cast<int>(calibration.size() / length), ntest = static_cast<int>(test.size() / length);
+
+	//background descriptors: a sample of windows, for the default model and the stage order
+	std::vector<float> background;
+	std::vector<int32_t> windows;
+	for (unsigned int k = 0; k < bg_maps.size(); ++k)
+	{
+		dense_windows(windows, bg_maps[k], xgrid, ygrid);
+		for (unsigned int n = 0; n < windows.size() / 2; n += 97)
+		{
+			background.resize(background.size() + length);
+			gather(&background[background.size() - length], bg_maps[k], windows[2*n], windows[2*n + 1], xgrid, ygrid);
+		}
+	}
+	const int nbackground = static_cast<int>(background.size() / length);
+	if (ncalibration == 0 || nbackground == 0)
+	{
+		std::cerr << "the images are smaller than a " << xgrid << "x" << ygrid << " block window\n";
+		return 1;
+	}
+
+	std::vector<float> weights;
+	float bias = 0;
+	if (model != 0)
+		load_model(model, weights, bias, xgrid, ygrid, unit);
+	else
+	{
+		//w = mean positive - mean background, threshold halfway between the means
+		std::vector<double> mean_pos(length, 0), mean_bg(length, 0);
+		for (int k = 0; k < ncalibration; ++k)
+			for (int j = 0; j < length; ++j) mean_pos[j] += calibration[k*length + j] / ncalibration;
+		for (int k = 0; k < nbackground; ++k)
+			for (int j = 0; j < length; ++j) mean_bg[j] += background[k*length + j] / nbackground;
+		weights.resize(length);
+		double b = 0;
+		for (int j = 0; j < length; ++j)
+		{
+			weights[j] = static_cast<float>(mean_pos[j] - mean_bg[j]);
+			b -= weights[j] * (mean_pos[j] + mean_bg[j]) / 2;
+		}
+		bias = static_cast<float>(b);
+	}
+
+	SoftCascade cascade(&weights[0], xgrid, ygrid, unit, bias);
+	cascade.learn_order(&background[0], length, nbackground);
+	SoftCascade full(cascade);
+	cascade.calibrate(&calibration[0], length, ncalibration, threshold, miss_rate);
+	if (fout != 0)
+		cascade.save(fout);
+
+	//recall of the held-out positives, relative to the full model
+	int full_hits = 0, cascade_hits = 0;
+	double test_stages = 0;
+	for (int k = 0; k < ntest; ++k)
+	{
+		float score = 0;
+		int stages = 0;
+		full.score(score, &test[k*length]);
+		bool full_hit = score >= threshold;
+		bool cascade_hit = cascade.score(score, &test[k*length], &stages) && score >= threshold;
+		full_hits += full_hit;
+		cascade_hits += full_hit && cascade_hit;
+		test_stages += stages;
+	}
+
+	//dense scanning of the background maps
+	LinearDetector detector(&weights[0], xgrid, ygrid, unit, bias);
+	Throughput t_full, t_cascade;
+	double t_detector = 0;
+	std::vector<float> scores;
+	ScoreMap score_map;
+	//pixel boxes and scores of the windows the full model accepts, image after image
+	std::vector<int32_t> detections;
+	std::vector<float> detection_scores;
+	std::vector<int> begin(1, 0);
+	for (unsigned int k = 0; k < bg_maps.size(); ++k)
+	{
+		dense_windows(windows, bg_maps[k], xgrid, ygrid);
+		const int count = static_cast<int>(windows.size() / 2);
+		if (count == 0)
+			continue;
+		scores.resize(count);
+
+		double start = now();
+		t_full.stages += full.score(&scores[0], &windows[0], count, bg_maps[k]);
+		t_full.seconds += now() - start;
+		for (int n = 0; n < count; ++n)
+			if (scores[n] >= threshold)
+			{
+				t_full.accepted++;
+				const int32_t box[4] = {windows[2*n]*cell, windows[2*n + 1]*cell, (windows[2*n] + xgrid + 1)*cell - 1, (windows[2*n + 1] + ygrid + 1)*cell - 1};
+				detections.insert(detections.end(), box, box + 4);
+				detection_scores.push_back(scores[n]);
+			}
+		begin.push_back(static_cast<int>(detection_scores.size()));
+
+		start = now();
+		t_cascade.stages += cascade.score(&scores[0], &windows[0], count, bg_maps[k]);
+		t_cascade.seconds += now() - start;
+		for (int n = 0; n < count; ++n) t_cascade.accepted += scores[n] >= threshold;
+
+		start = now();
+		detector.score(score_map, bg_maps[k]);
+		t_detector += now() - start;
+
+		t_full.windows += count;
+		t_cascade.windows += count;
+	}
+
+	//suppression of the detections of each image, greedy against the all-pairs reference
+	NonMaxSuppression::Param nms_param;
+	NonMaxSuppression nms(nms_param);
+	NonMaxSuppression::Param soft_param(NonMaxSuppression::gaussian);
+	NonMaxSuppression soft_nms(soft_param);
+	std::vector<int> keep, reference;
+	std::vector<float> kept_scores;
+	const int ndetections = static_cast<int>(detection_scores.size()), nbegin = static_cast<int>(begin.size()) - 1;
+	double t_nms = 0, t_soft = 0;
+	int nsoft = 0;
+	if (ndetections > 0)
+	{
+		double start = now();
+		nms.suppress(keep, kept_scores, &detections[0], &detection_scores[0], &begin[0], nbegin);
+		t_nms = now() - start;
+		start = now();
+		nsoft = soft_nms.suppress(reference, kept_scores, &detections[0], &detection_scores[0], &begin[0], nbegin);
+		t_soft = now() - start;
+	}
+	reference.clear();
+	for (int i = 0; i < nbegin; ++i)
+		greedy_reference(reference, detections, detection_scores, begin[i], begin[i + 1], nms_param.overlap);
+	const bool nms_matches = keep == reference;
+
+	std::cout << pos_maps.size() << " positive images (" << ncalibration << " calibration, " << ntest << " test), "
+		<< bg_maps.size() << " background images, " << xgrid << "x" << ygrid << " blocks of 2x2 cells of " << cell << " pixels, "
+		<< cascade.stages() << " stages\n"
+		<< "threshold " << threshold << ", miss rate per stage " << miss_rate << (model ? "" : ", mean difference model") << "\n"
+		<< "evaluation\twindows/s\tstages/window\taccepted\n"
+		<< "full\t" << t_full.windows / t_full.seconds << "\t" << t_full.stages / t_full.windows << "\t" << t_full.accepted << "\n"
+		<< "cascade\t" << t_cascade.windows / t_cascade.seconds << "\t" << t_cascade.stages / t_cascade.windows << "\t" << t_cascade.accepted << "\n"
+		<< "dense\t" << t_full.windows / t_detector << "\t-\t-\n"
+		<< "speedup over full evaluation " << t_full.seconds / t_cascade.seconds << "x\n"
+		<< "held-out positives: full " << full_hits << "/" << ntest << ", cascade " << cascade_hits << "/" << ntest
+		<< ", recall loss " << (full_hits > 0 ? 1 - static_cast<double>(cascade_hits) / full_hits : 0)
+		<< ", stages/window " << (ntest > 0 ? test_stages / ntest : 0) << "\n"
+		<< "nms of " << ndetections << " detections: greedy keeps " << keep.size() << " (" << (t_nms > 0 ? ndetections / t_nms : 0)
+		<< " boxes/s, " << (nms_matches ? "matches" : "DIFFERS FROM") << " all-pairs greedy), gaussian soft keeps " << nsoft
+		<< " (" << (t_soft > 0 ? ndetections / t_soft : 0) << " boxes/s)\n";
+	return nms_matches ? 0 : 1;
+}
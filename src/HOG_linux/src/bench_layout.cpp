@@ -0,0 +1,157 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Compares the interleaved and planar integral histogram layouts for sparse
+//              keypoint windows and for dense sliding cells.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/time.h>
+#include <boost/lexical_cast.hpp>
+
+#include "integral_histogram.h"
+
+void help_exit(const char *app_name)
+{
+	std::cout << "usage: " << app_name << " [options] \n"
+		<< "\t-i \t input image, default: random image\n"
+		<< "\t-W \t random image width, default 1280\n"
+		<< "\t-H \t random image height, default 960\n"
+		<< "\t-n \t number of sparse windows, default 20000\n"
+		<< "\t-p \t patch size, default 32\n"
+		<< "\t-c \t dense cell size, default 8\n"
+		<< "\t-h \t display this message\n";
+	exit(1);
+}
+
+double now()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+//4x4 grid of cells per window, as HOGExtractor does
+template<typename Layout>
+double bench_sparse(const BasicIntegralHistogram<Layout> &inthist, const std::vector<int> &kp, int patch_size, float &checksum)
+{
+	const int grid = 4;
+	std::vector<int> cells(grid*grid*4);
+	std::vector<float> dscr(grid*grid*inthist.dirnum());
+	double start = now();
+	for (unsigned int k = 0; k < kp.size(); k += 2)
+	{
+		int step = patch_size / grid;
+		for (int i = 0; i < grid; ++i)
+			for (int j = 0; j < grid; ++j)
+			{
+				cells[(i*grid + j)*4 + 0] = kp[k] + step*i;
+				cells[(i*grid + j)*4 + 1] = kp[k + 1] + step*j;
+				cells[(i*grid + j)*4 + 2] = kp[k] + step*(i + 1) - 1;
+				cells[(i*grid + j)*4 + 3] = kp[k + 1] + step*(j + 1) - 1;
+			}
+		inthist.get_hist(dscr.begin(), cells.begin(), cells.end(), true);
+		checksum += dscr[0];
+	}
+	return now() - start;
+}
+
+//histogram of the cell x cell box at every pixel
+template<typename Layout>
+double bench_dense(const BasicIntegralHistogram<Layout> &inthist, int cell, float &checksum)
+{
+	int count = inthist.width() - cell + 1;
+	std::vector<float> hist(count*inthist.dirnum());
+	double start = now();
+	for (int y = 0; y + cell <= inthist.height(); ++y)
+	{
+		inthist.get_hist_row(&hist[0], 0, y, cell - 1, y + cell - 1, count);
+		checksum += hist[count/2];
+	}
+	return now() - start;
+}
+
+template<typename Layout>
+void run(const char *name, const Image &im, const std::vector<int> &kp, int patch_size, int cell)
+{
+	IntegralHistogram::Param param;
+	BasicIntegralHistogram<Layout> inthist(param);
+	Image img(im);
+	double t_build = now();
+	inthist.build(img);
+	t_build = now() - t_build;
+
+	float checksum = 0;
+	double t_sparse = bench_sparse(inthist, kp, patch_size, checksum);
+	double t_dense = bench_dense(inthist, cell, checksum);
+	int cells = (inthist.width() - cell + 1)*(inthist.height() - cell + 1);
+	std::cout << name << "\tbuild " << t_build*1e3 << " ms"
+		<< "\tsparse " << kp.size()/2/t_sparse << " windows/s"
+		<< "\tdense " << cells/t_dense << " cells/s"
+		<< "\t(checksum " << checksum << ")\n";
+}
+
+int main( int argc, char *argv[] )
+{
+	const char *fin = 0;
+	int width = 1280, height = 960;
+	int nwindows = 20000;
+	int patch_size = 32;
+	int cell = 8;
+
+	int c;
+	while ((c = getopt(argc, argv, "i:W:H:n:p:c:h")) != -1)
+	{
+		switch (c)
+		{
+		case 'i':
+			fin = optarg;
+			break;
+		case 'W':
+			width = boost::lexical_cast<int>(optarg);
+			break;
+		case 'H':
+			height = boost::lexical_cast<int>(optarg);
+			break;
+		case 'n':
+			nwindows = boost::lexical_cast<int>(optarg);
+			break;
+		case 'p':
+			patch_size = boost::lexical_cast<int>(optarg);
+			break;
+		case 'c':
+			cell = boost::lexical_cast<int>(optarg);
+			break;
+		case 'h':
+		case '?':
+		default:
+			help_exit(argv[0]);
+			break;
+		}
+	}
+
+	srand(0);
+	Image im;
+	if (fin != 0)
+		im.load(fin);
+	else
+	{
+		im.assign(width, height);
+		cimg_forXY(im, x, y) im(x, y) = static_cast<float>(rand() % 256);
+		im.blur(1.5);
+	}
+
+	std::vector<int> kp(2*nwindows);
+	for (int k = 0; k < nwindows; ++k)
+	{
+		kp[2*k] = rand() % (im.dimx() - patch_size);
+		kp[2*k + 1] = rand() % (im.dimy() - patch_size);
+	}
+
+	std::cout << im.dimx() << "x" << im.dimy() << ", " << nwindows << " sparse " << patch_size << "px windows, dense "
+		<< cell << "px cells\n";
+	run<InterleavedLayout>("interleaved", im, kp, patch_size, cell);
+	run<PlanarLayout>("planar", im, kp, patch_size, cell);
+	return 0;
+}
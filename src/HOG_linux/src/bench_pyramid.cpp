@@ -0,0 +1,223 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Build time of exact and approximate feature pyramids and the descriptor error of
+//              the approximate levels, over a list of images such as the INRIA positives.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/time.h>
+#include <boost/lexical_cast.hpp>
+
+#include "feature_pyramid.h"
+
+void help_exit(const char *app_name)
+{
+	std::cout << "usage: " << app_name << " [options] \n"
+		<< "\t-r \t data root, default ../../inria\n"
+		<< "\t-l \t image list under the root, default Train/pos.lst\n"
+		<< "\t-i \t single input image instead of the list\n"
+		<< "\t-n \t number of images, default 20\n"
+		<< "\t-s \t scale step, default 1.1\n"
+		<< "\t-L \t power law exponent lambda, default 0.1\n"
+		<< "\t-x \t window width, default 64\n"
+		<< "\t-y \t window height, default 128\n"
+		<< "\t-t \t number of threads, default 1\n"
+		<< "\t-h \t display this message\n";
+	exit(1);
+}
+
+double now()
+{
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+//gradient energy per pixel of a level, for fitting lambda
+double energy(const IntegralHistogram &inthist)
+{
+	const float *total = inthist.get_inthist(inthist.width() - 1, inthist.height() - 1);
+	double sum = 0;
+	for (int idir = 0; idir < inthist.dirnum(); ++idir) sum += total[idir*inthist.bin_stride()];
+	return sum / (static_cast<double>(inthist.width())*inthist.height());
+}
+
+struct LevelStats
+{
+	double error;    //sum of |approximate - exact| / |exact| over windows
+	double windows;
+	double log_scale;
+	double log_energy;   //sum of log(energy / energy of level 0) over images
+	int images;
+	LevelStats():error(0),windows(0),log_scale(0),log_energy(0),images(0){}
+};
+
+int main( int argc, char *argv[] )
+{
+	std::string root = "../../inria", list = "Train/pos.lst";
+	const char *fin = 0;
+	int nimages = 20;
+	FeaturePyramid::Param pyramid_param(1.1f, 64, 128);
+
+	int c;
+	while ((c = getopt(argc, argv, "r:l:i:n:s:L:x:y:t:h")) != -1)
+	{
+		switch (c)
+		{
+		case 'r':
+			root = optarg;
+			break;
+		case 'l':
+			list = optarg;
+			break;
+		case 'i':
+			fin = optarg;
+			break;
+		case 'n':
+			nimages = boost::lexical_cast<int>(optarg);
+			break;
+		case 's':
+			pyramid_param.scale_step = boost::lexical_cast<float>(optarg);
+			break;
+		case 'L':
+			pyramid_param.lambda = boost::lexical_cast<float>(optarg);
+			break;
+		case 'x':
+			pyramid_param.window_width = boost::lexical_cast<int>(optarg);
+			break;
+		case 'y':
+			pyramid_param.window_height = boost::lexical_cast<int>(optarg);
+			break;
+		case 't':
+			pyramid_param.nthreads = boost::lexical_cast<int>(optarg);
+			break;
+		case 'h':
+		case '?':
+		default:
+			help_exit(argv[0]);
+			break;
+		}
+	}
+
+	std::vector<std::string> files;
+	if (fin != 0)
+		files.push_back(fin);
+	else
+	{
+		std::ifstream ins((root + "/" + list).c_str());
+		std::string line;
+		while (static_cast<int>(files.size()) < nimages && std::getline(ins, line))
+			if (!line.empty())
+				files.push_back(root + "/" + line);
+	}
+
+	IntegralHistogram::Param inthist_param;
+	//the error is measured on the raw cell histograms: normalized cells of flat areas are float
+	//noise divided by noise in either pyramid
+	HOGExtractor::Param hog_param(4, 4, false);
+	FeaturePyramid::Param approximate_param(pyramid_param);
+	approximate_param.approximate = true;
+	FeaturePyramid exact(pyramid_param, inthist_param, hog_param);
+	FeaturePyramid approximate(approximate_param, inthist_param, hog_param);
+
+	cimg::exception_mode() = 0;
+	std::vector<LevelStats> stats;
+	double t_exact = 0, t_approximate = 0;
+	int loaded = 0;
+	for (unsigned int f = 0; f < files.size(); ++f)
+	{
+		Image im;
+		try
+		{
+			im.load(files[f].c_str());
+		}
+		catch (CImgException &)
+		{
+			std::cerr << "can not load " << files[f] << "\n";
+			continue;
+		}
+		++loaded;
+
+		double start = now();
+		exact.build(im);
+		t_exact += now() - start;
+		start = now();
+		approximate.build(im);
+		t_approximate += now() - start;
+
+		//windows on an 8 pixel lattice of every level, compared level by level
+		if (static_cast<int>(stats.size()) < exact.levels())
+			stats.resize(exact.levels());
+		double energy0 = energy(exact.level(0));
+		for (int l = 0; l < exact.levels(); ++l)
+		{
+			std::vector<int32_t> windows;
+			for (int y = 0; y + pyramid_param.window_height <= exact.level(l).height(); y += 8)
+				for (int x = 0; x + pyramid_param.window_width <= exact.level(l).width(); x += 8)
+				{
+					windows.push_back(x);
+					windows.push_back(y);
+					windows.push_back(l);
+				}
+			int count = static_cast<int>(windows.size() / 3);
+			std::vector<float> d_exact(static_cast<size_t>(count)*exact.length()), d_approximate(d_exact.size());
+			if (count > 0)
+			{
+				exact.extract(&d_exact[0], exact.length(), &windows[0], count);
+				approximate.extract(&d_approximate[0], approximate.length(), &windows[0], count);
+			}
+			for (int k = 0; k < count; ++k)
+			{
+				double diff = 0, norm = 0;
+				for (int j = 0; j < exact.length(); ++j)
+				{
+					double e = d_exact[k*exact.length() + j], a = d_approximate[k*exact.length() + j];
+					diff += (a - e)*(a - e);
+					norm += e*e;
+				}
+				stats[l].error += norm > 0 ? std::sqrt(diff / norm) : 0;
+			}
+			stats[l].windows += count;
+			stats[l].log_scale = std::log(exact.scale(l));
+			if (l > 0 && energy0 > 0 && energy(exact.level(l)) > 0)
+			{
+				stats[l].log_energy += std::log(energy(exact.level(l)) / energy0);
+				stats[l].images++;
+			}
+		}
+	}
+	if (loaded == 0)
+	{
+		std::cerr << "no image could be loaded\n";
+		return 1;
+	}
+
+	std::cout << loaded << " images, scale step " << pyramid_param.scale_step << ", " << pyramid_param.window_width << "x"
+		<< pyramid_param.window_height << " windows, lambda " << pyramid_param.lambda << "\n"
+		<< "build: exact " << t_exact/loaded*1e3 << " ms, approximate " << t_approximate/loaded*1e3 << " ms per image ("
+		<< t_exact/t_approximate << "x)\n"
+		<< "level\tscale\texact\twindows\tmean relative L2 error of the cell histograms\n";
+	//least squares fit of log(energy ratio) = -lambda*log(scale) through the origin
+	double sxy = 0, sxx = 0, error = 0, windows = 0;
+	for (unsigned int l = 0; l < stats.size(); ++l)
+	{
+		std::cout << l << "\t" << std::exp(stats[l].log_scale) << "\t" << (approximate.levels() > static_cast<int>(l) && approximate.exact(l) ? "yes" : "no")
+			<< "\t" << stats[l].windows << "\t" << (stats[l].windows > 0 ? stats[l].error / stats[l].windows : 0) << "\n";
+		error += stats[l].error;
+		windows += stats[l].windows;
+		if (stats[l].images > 0)
+		{
+			sxy += stats[l].log_scale * stats[l].log_energy;
+			sxx += stats[l].log_scale * stats[l].log_scale * stats[l].images;
+		}
+	}
+	std::cout << "overall mean relative L2 error " << (windows > 0 ? error / windows : 0) << "\n";
+	if (sxx > 0)
+		std::cout << "lambda fitted on the exact levels " << -sxy / sxx << "\n";
+	return 0;
+}
@@ -0,0 +1,214 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Soft cascade evaluation of a linear window classifier.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "cascade.h"
+
+#include <boost/format.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	inline float dot(const float *w, const float *x, int n)
+	{
+		float sum = 0;
+		for (int b = 0; b < n; ++b) sum += w[b]*x[b];
+		return sum;
+	}
+
+	inline int unit_length(const CellMap &cells) { return cells.dirnum(); }
+	inline int unit_length(const BlockMap &blocks) { return blocks.length(); }
+
+	//sorts unit indices by decreasing weight
+	struct ByWeight
+	{
+		const std::vector<double> *weight;
+		ByWeight(const std::vector<double> &w):weight(&w){}
+		bool operator()(int a, int b) const { return (*weight)[a] > (*weight)[b]; }
+	};
+}
+
+SoftCascade::SoftCascade(const float *weights, int xgrid, int ygrid, int unit, float bias)
+	:_xgrid(xgrid),_ygrid(ygrid),_unit(unit),_bias(bias)
+{
+	if (xgrid < 1 || ygrid < 1 || unit < 1)
+		throw std::runtime_error( boost::str(boost::format("Invalid cascade shape %1%x%2%x%3%") % xgrid % ygrid % unit) );
+	_weights.assign(weights, weights + length());
+	std::vector<int> order(stages());
+	for (int k = 0; k < stages(); ++k) order[k] = k;
+	set_order(order);
+}
+
+void SoftCascade::set_order(const std::vector<int> &order)
+{
+	_order = order;
+	_dx.resize(stages());
+	_dy.resize(stages());
+	for (int k = 0; k < stages(); ++k)
+	{
+		_dx[k] = _order[k] / _ygrid;
+		_dy[k] = _order[k] % _ygrid;
+	}
+	reset_thresholds();
+}
+
+void SoftCascade::reset_thresholds()
+{
+	_thresholds.assign(stages(), -FLT_MAX);
+}
+
+void SoftCascade::learn_order(const float *dscr, size_t stride, int count)
+{
+	std::vector<double> contribution(stages(), 0);
+	for (int k = 0; k < count; ++k)
+		for (int u = 0; u < stages(); ++u)
+			contribution[u] += std::fabs(dot(&_weights[u*_unit], dscr + k*stride + u*_unit, _unit));
+
+	std::vector<int> order(stages());
+	for (int u = 0; u < stages(); ++u) order[u] = u;
+	std::stable_sort(order.begin(), order.end(), ByWeight(contribution));
+	set_order(order);
+}
+
+void SoftCascade::calibrate(const float *dscr, size_t stride, int count, float threshold, float miss_rate)
+{
+	reset_thresholds();
+	std::vector<const float *> alive;
+	std::vector<float> partial;
+	for (int k = 0; k < count; ++k)
+	{
+		const float *d = dscr + k*stride;
+		if (_bias + dot(&_weights[0], d, length()) >= threshold)
+		{
+			alive.push_back(d);
+			partial.push_back(_bias);
+		}
+	}
+	if (alive.empty())
+		throw std::runtime_error( boost::str(boost::format("No positive scores >= %1%, the cascade can not be calibrated") % threshold) );
+
+	std::vector<float> sorted;
+	for (int k = 0; k < stages(); ++k)
+	{
+		const int u = _order[k];
+		for (unsigned int a = 0; a < alive.size(); ++a)
+			partial[a] += dot(&_weights[u*_unit], alive[a] + u*_unit, _unit);
+
+		//the threshold is the smallest partial score kept, the positives below it are dropped
+		sorted = partial;
+		size_t drop = static_cast<size_t>(miss_rate * sorted.size());
+		drop = std::min(drop, sorted.size() - 1);
+		std::nth_element(sorted.begin(), sorted.begin() + drop, sorted.end());
+		_thresholds[k] = sorted[drop];
+
+		size_t kept = 0;
+		for (unsigned int a = 0; a < alive.size(); ++a)
+			if (partial[a] >= _thresholds[k])
+			{
+				alive[kept] = alive[a];
+				partial[kept++] = partial[a];
+			}
+		alive.resize(kept);
+		partial.resize(kept);
+	}
+}
+
+bool SoftCascade::score(float &score, const float *dscr, int *stages_run) const
+{
+	score = _bias;
+	for (int k = 0; k < stages(); ++k)
+	{
+		score += dot(&_weights[_order[k]*_unit], dscr + _order[k]*_unit, _unit);
+		if (score < _thresholds[k])
+		{
+			if (stages_run) *stages_run = k + 1;
+			return false;
+		}
+	}
+	if (stages_run) *stages_run = stages();
+	return true;
+}
+
+template<typename Map>
+long SoftCascade::score_map(float *scores, const int32_t *windows, int count, const Map &map) const
+{
+	if (unit_length(map) != _unit)
+		throw std::runtime_error( boost::str(boost::format("Cascade unit %1% does not match the map unit %2%") % _unit % unit_length(map)) );
+
+	//weights in stage order, read front to back
+	std::vector<float> staged(length());
+	for (int k = 0; k < stages(); ++k)
+		std::copy(&_weights[_order[k]*_unit], &_weights[_order[k]*_unit] + _unit, &staged[k*_unit]);
+
+	long evaluated = 0;
+	for (int n = 0; n < count; ++n)
+	{
+		const int cx = windows[2*n], cy = windows[2*n + 1];
+		if (cx < 0 || cy < 0 || cx + _xgrid > map.cols() || cy + _ygrid > map.rows())
+			throw std::runtime_error( boost::str(boost::format("Window [%1% %2%] is outside the map") % cx % cy) );
+
+		float score = _bias;
+		int k = 0;
+		while (k < stages())
+		{
+			score += dot(&staged[k*_unit], map.hist(cx + _dx[k], cy + _dy[k]), _unit);
+			if (score < _thresholds[k++])
+			{
+				score = -FLT_MAX;
+				break;
+			}
+		}
+		scores[n] = score;
+		evaluated += k;
+	}
+	return evaluated;
+}
+
+long SoftCascade::score(float *scores, const int32_t *windows, int count, const CellMap &cells) const
+{
+	return score_map(scores, windows, count, cells);
+}
+
+long SoftCascade::score(float *scores, const int32_t *windows, int count, const BlockMap &blocks) const
+{
+	return score_map(scores, windows, count, blocks);
+}
+
+void SoftCascade::save(const char *fn) const
+{
+	std::fstream fout(fn, std::ios::out);
+	if (!fout.good())
+		throw std::runtime_error( boost::str(boost::format("Failed to open %1%") % fn ) );
+	fout << _xgrid << " " << _ygrid << " " << _unit << "\n";
+	fout.precision(9);
+	for (int k = 0; k < stages(); ++k)
+		fout << _order[k] << " " << _thresholds[k] << "\n";
+}
+
+void SoftCascade::load(const char *fn)
+{
+	std::fstream fin(fn, std::ios::in);
+	if (!fin.good())
+		throw std::runtime_error( boost::str(boost::format("Failed to open %1%") % fn ) );
+	int xgrid = 0, ygrid = 0, unit = 0;
+	fin >> xgrid >> ygrid >> unit;
+	if (xgrid != _xgrid || ygrid != _ygrid || unit != _unit)
+		throw std::runtime_error( boost::str(boost::format("%1% is a %2%x%3%x%4% cascade") % fn % xgrid % ygrid % unit) );
+
+	std::vector<int> order(stages());
+	std::vector<float> thresholds(stages());
+	std::vector<bool> seen(stages(), false);
+	for (int k = 0; k < stages(); ++k)
+	{
+		fin >> order[k] >> thresholds[k];
+		if (!fin || order[k] < 0 || order[k] >= stages() || seen[order[k]])
+			throw std::runtime_error( boost::str(boost::format("Failed to read stage %1% of %2%") % k % fn ) );
+		seen[order[k]] = true;
+	}
+	set_order(order);
+	_thresholds = thresholds;
+}
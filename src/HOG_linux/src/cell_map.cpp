@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Histograms of a regular lattice of cells and their L2-Hys normalized blocks.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "cell_map.h"
+#include "hist_simd.h"
+#include "parallel.h"
+
+#include <boost/format.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float L2HYS_EPS = 1e-3f;
+
+	//v *= 1/sqrt(|v|^2 + eps^2), then clipped at clip when clip > 0
+	inline void l2_scale(float *v, int n, float clip)
+	{
+		float ss = 0;
+		for (int i = 0; i < n; ++i) ss += v[i]*v[i];
+		float scale = 1.0f / std::sqrt(ss + L2HYS_EPS*L2HYS_EPS);
+		for (int i = 0; i < n; ++i) v[i] *= scale;
+		if (clip > 0)
+			for (int i = 0; i < n; ++i) v[i] = std::min(v[i], clip);
+	}
+}
+
+void CellMap::build(const IntegralHistogram &inthist, int cell, bool normalize, int nthreads)
+{
+	if (cell < 1)
+		throw std::runtime_error( boost::str(boost::format("Invalid cell size %1%") % cell) );
+
+	_cell = cell;
+	_cols = inthist.width() / cell;
+	_rows = inthist.height() / cell;
+	_dirnum = inthist.dirnum();
+	_hist.resize(static_cast<size_t>(_cols)*_rows*_dirnum);
+	if (_rows > 0)
+		parallel_for(0, _cols, nthreads, boost::bind(&CellMap::build_cols, this, &inthist, normalize, _1, _2));
+}
+
+//columns [col_begin, col_end) as one window of the integral histogram, so every corner is read once
+void CellMap::build_cols(const IntegralHistogram *inthist, bool normalize, int col_begin, int col_end)
+{
+	std::vector<int> grid(col_end - col_begin + _rows + 2);
+	int *xs = &grid[0], *ys = xs + col_end - col_begin + 1;
+	for (int i = col_begin; i <= col_end; ++i) xs[i - col_begin] = i*_cell;
+	for (int j = 0; j <= _rows; ++j) ys[j] = j*_cell;
+	inthist->get_window_hist_unchecked(&_hist[static_cast<size_t>(col_begin)*_rows*_dirnum], xs, col_end - col_begin, ys, _rows, normalize);
+}
+
+void BlockMap::build(const CellMap &cells, int block, float clip, int nthreads)
+{
+	if (block < 1)
+		throw std::runtime_error( boost::str(boost::format("Invalid block size %1%") % block) );
+
+	_cell = cells.cell();
+	_block = block;
+	_cols = std::max(cells.cols() - block + 1, 0);
+	_rows = std::max(cells.rows() - block + 1, 0);
+	_length = block*block*cells.dirnum();
+	_clip = clip;
+	_avx2 = hist8_avx2_supported();
+	_hist.resize(static_cast<size_t>(_cols)*_rows*_length);
+	if (_rows > 0)
+		parallel_for(0, _cols, nthreads, boost::bind(&BlockMap::build_cols, this, &cells, _1, _2));
+}
+
+//the block*dirnum floats of a block column are adjacent in the cell map, so a block is
+//assembled from block copies; the normalization then runs over the whole band at once
+void BlockMap::build_cols(const CellMap *cells, int col_begin, int col_end)
+{
+	const int column = _block*cells->dirnum();
+	float *dst = &_hist[static_cast<size_t>(col_begin)*_rows*_length];
+	for (int bx = col_begin; bx < col_end; ++bx)
+		for (int by = 0; by < _rows; ++by)
+			for (int i = 0; i < _block; ++i, dst += column)
+				std::copy(cells->hist(bx + i, by), cells->hist(bx + i, by) + column, dst);
+
+	float *band = &_hist[static_cast<size_t>(col_begin)*_rows*_length];
+	int count = (col_end - col_begin)*_rows;
+	if (_avx2)
+		l2hys_avx2(band, count, _length, _clip, L2HYS_EPS);
+	else
+		for (int k = 0; k < count; ++k, band += _length)
+		{
+			l2_scale(band, _length, _clip);
+			l2_scale(band, _length, 0);
+		}
+}
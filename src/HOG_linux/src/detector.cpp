@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Dense scoring of a linear window classifier on cell and block maps.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "detector.h"
+#include "hist_simd.h"
+#include "parallel.h"
+
+#include <boost/format.hpp>
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DETECTOR_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	//output rows scored per pass over the filters, the partial scores of a tile stay in L1
+	const int TILE = 256;
+
+	//acc[t] += sum_j w[j]*src[t + j] for t < n
+	inline void correlate(float *acc, const float *src, const float *w, int taps, int n)
+	{
+		for (int t = 0; t < n; ++t)
+		{
+			float sum = 0;
+			for (int j = 0; j < taps; ++j) sum += w[j]*src[t + j];
+			acc[t] += sum;
+		}
+	}
+
+#if defined(DETECTOR_AVX2)
+	__attribute__((target("avx2"))) void correlate_avx2(float *acc, const float *src, const float *w, int taps, int n)
+	{
+		int t = 0;
+		for (; t + 8 <= n; t += 8)
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for (int j = 0; j < taps; ++j)
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(w[j]), _mm256_loadu_ps(src + t + j)));
+			_mm256_storeu_ps(acc + t, _mm256_add_ps(_mm256_loadu_ps(acc + t), sum));
+		}
+		correlate(acc + t, src + t, w, taps, n - t);
+	}
+#endif
+
+	inline int unit_length(const CellMap &cells) { return cells.dirnum(); }
+	inline int unit_length(const BlockMap &blocks) { return blocks.length(); }
+
+	//planes[(b*cols + cx)*rows + cy] = map.hist(cx, cy)[b] for the columns [col_begin, col_end)
+	template<typename Map>
+	struct SplitPlanes
+	{
+		float *planes;
+		const Map *map;
+		SplitPlanes(float *p, const Map &m):planes(p),map(&m){}
+		void operator()(int col_begin, int col_end)
+		{
+			const int cols = map->cols(), rows = map->rows(), unit = unit_length(*map);
+			for (int cx = col_begin; cx < col_end; ++cx)
+				for (int cy = 0; cy < rows; ++cy)
+				{
+					const float *hist = map->hist(cx, cy);
+					for (int b = 0; b < unit; ++b)
+						planes[(static_cast<size_t>(b)*cols + cx)*rows + cy] = hist[b];
+				}
+		}
+	};
+
+	//score columns [col_begin, col_end): tile by tile, every plane column under the window is
+	//correlated with the matching filter column
+	struct CorrelateColumns
+	{
+		const float *planes;
+		int cols;
+		int rows;
+		int unit;
+		const float *filters;
+		int xgrid;
+		int ygrid;
+		float bias;
+		ScoreMap *scores;
+		bool avx2;
+		CorrelateColumns(const float *p, int c, int r, int u, const float *f, int xg, int yg, float b, ScoreMap &s)
+			:planes(p),cols(c),rows(r),unit(u),filters(f),xgrid(xg),ygrid(yg),bias(b),scores(&s),avx2(hist8_avx2_supported()){}
+
+		void operator()(int col_begin, int col_end)
+		{
+			for (int cx = col_begin; cx < col_end; ++cx)
+			{
+				float *out = scores->column(cx);
+				std::fill(out, out + scores->rows(), bias);
+				for (int t0 = 0; t0 < scores->rows(); t0 += TILE)
+				{
+					int n = std::min(TILE, scores->rows() - t0);
+					for (int b = 0; b < unit; ++b)
+						for (int i = 0; i < xgrid; ++i)
+						{
+							const float *src = planes + (static_cast<size_t>(b)*cols + cx + i)*rows + t0;
+							const float *w = filters + (b*xgrid + i)*ygrid;
+#if defined(DETECTOR_AVX2)
+							if (avx2)
+							{
+								correlate_avx2(out + t0, src, w, ygrid, n);
+								continue;
+							}
+#endif
+							correlate(out + t0, src, w, ygrid, n);
+						}
+				}
+			}
+		}
+	};
+}
+
+LinearDetector::LinearDetector(const float *weights, int xgrid, int ygrid, int unit, float bias)
+	:_xgrid(xgrid),_ygrid(ygrid),_unit(unit),_bias(bias)
+{
+	if (xgrid < 1 || ygrid < 1 || unit < 1)
+		throw std::runtime_error( boost::str(boost::format("Invalid detector shape %1%x%2%x%3%") % xgrid % ygrid % unit) );
+	_filters.resize(static_cast<size_t>(xgrid)*ygrid*unit);
+	for (int i = 0; i < xgrid; ++i)
+		for (int j = 0; j < ygrid; ++j)
+			for (int b = 0; b < unit; ++b)
+				_filters[(b*xgrid + i)*ygrid + j] = weights[(i*ygrid + j)*unit + b];
+}
+
+template<typename Map>
+void LinearDetector::score_map(ScoreMap &scores, const Map &map, int nthreads) const
+{
+	if (unit_length(map) != _unit)
+		throw std::runtime_error( boost::str(boost::format("Detector unit %1% does not match the map unit %2%") % _unit % unit_length(map)) );
+
+	int cols = map.cols() - _xgrid + 1, rows = map.rows() - _ygrid + 1;
+	if (cols <= 0 || rows <= 0)
+	{
+		scores.resize(0, 0);
+		return;
+	}
+	scores.resize(cols, rows);
+
+	std::vector<float> planes(static_cast<size_t>(map.cols())*map.rows()*_unit);
+	parallel_for(0, map.cols(), nthreads, SplitPlanes<Map>(&planes[0], map));
+	parallel_for(0, cols, nthreads, CorrelateColumns(&planes[0], map.cols(), map.rows(), _unit, &_filters[0], _xgrid, _ygrid, _bias, scores));
+}
+
+void LinearDetector::score(ScoreMap &scores, const CellMap &cells, int nthreads) const
+{
+	score_map(scores, cells, nthreads);
+}
+
+void LinearDetector::score(ScoreMap &scores, const BlockMap &blocks, int nthreads) const
+{
+	score_map(scores, blocks, nthreads);
+}
+
+void LinearDetector::score(std::vector<ScoreMap> &scores, const FeaturePyramid &pyramid, int cell, bool normalize, int nthreads) const
+{
+	scores.resize(pyramid.levels());
+	CellMap cells;
+	for (int l = 0; l < pyramid.levels(); ++l)
+	{
+		cells.build(pyramid.level(l), cell, normalize, nthreads);
+		score(scores[l], cells, nthreads);
+	}
+}
@@ -0,0 +1,202 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Image pyramid with an integral histogram per level.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "feature_pyramid.h"
+#include "parallel.h"
+
+#include <boost/format.hpp>
+#include <stdexcept>
+#include <cmath>
+
+namespace
+{
+	//windows [begin, end) of a flat [x y level] array
+	struct ExtractWindows
+	{
+		float *dscr;
+		size_t stride;
+		const int32_t *windows;
+		const FeaturePyramid *pyramid;
+		const std::vector<ExtractionPlan> *plans;
+		bool normalize;
+		ExtractWindows(float *d, size_t s, const int32_t *w, const FeaturePyramid *p, const std::vector<ExtractionPlan> *pl, bool n)
+			:dscr(d),stride(s),windows(w),pyramid(p),plans(pl),normalize(n){}
+
+		void operator()(int begin, int end)
+		{
+			for (int k = begin; k < end; ++k)
+			{
+				const int32_t *window = windows + 3*k;
+				if (window[2] < 0 || window[2] >= pyramid->levels() || !(*plans)[window[2]].fits(window[0], window[1]))
+					throw std::runtime_error( boost::str(boost::format("Window [%1% %2% level %3%] is outside the pyramid") % window[0] % window[1] % window[2]) );
+				(*plans)[window[2]].extract(dscr + k*stride, window[0], window[1], normalize);
+			}
+		}
+	};
+}
+
+const float FeaturePyramid::default_lambda = 0.1f;
+
+FeaturePyramid::FeaturePyramid(Param &param, IntegralHistogram::Param &inthist_param, HOGExtractor::Param &hog_param)
+	:_param(param),_inthist_param(inthist_param),_hog_param(hog_param),_image_width(0),_image_height(0)
+{
+	if (_param.scale_step <= 1)
+		throw std::runtime_error( boost::str(boost::format("Pyramid scale step %1% should be > 1") % _param.scale_step) );
+}
+
+FeaturePyramid::~FeaturePyramid()
+{
+	clear();
+}
+
+void FeaturePyramid::clear()
+{
+	for (unsigned int l = 0; l < _levels.size(); ++l)
+		delete _levels[l];
+	_levels.clear();
+	_scales.clear();
+	_sources.clear();
+	_plans.clear();
+}
+
+void FeaturePyramid::build(const Image &img)
+{
+	clear();
+	_image_width = static_cast<int>(img.dimx());
+	_image_height = static_cast<int>(img.dimy());
+	for (int l = 0; _param.max_levels <= 0 || l < _param.max_levels; ++l)
+	{
+		float scale = std::pow(_param.scale_step, -static_cast<float>(l));
+		if (scaled(_image_width, scale) < _param.window_width || scaled(_image_height, scale) < _param.window_height)
+			break;
+		_scales.push_back(scale);
+		_sources.push_back(-1);
+	}
+
+	//with threads over the levels each level is built by one thread
+	IntegralHistogram::Param level_param(_inthist_param);
+	if (_param.nthreads > 1)
+		level_param.nthreads = 1;
+	for (unsigned int l = 0; l < _scales.size(); ++l)
+		_levels.push_back(new IntegralHistogram(level_param));
+
+	if (_param.approximate)
+		build_approximate(img);
+	else
+		build_exact(img);
+
+	for (int l = 0; l < levels(); ++l)
+		_plans.push_back(ExtractionPlan(*_levels[l], _param.window_width, _param.window_height, _hog_param.xgrid, _hog_param.ygrid));
+}
+
+void FeaturePyramid::build_exact(const Image &img)
+{
+	//level l is resampled from level l - 1 by moving average, the resampling is sequential and
+	//cheap next to the histograms
+	std::vector<Image> images;
+	for (int l = 0; l < levels(); ++l)
+	{
+		if (l == 0)
+			images.push_back(img);
+		else
+			images.push_back(images.back().get_resize(scaled(_image_width, _scales[l]), scaled(_image_height, _scales[l]), -100, -100, 2));
+	}
+	//the levels shrink geometrically, so single-level chunks from the top keep the threads busy
+	parallel_for_stealing(0, levels(), 1, _param.nthreads, boost::bind(&FeaturePyramid::build_levels, this, &images, &_levels, _1, _2));
+}
+
+void FeaturePyramid::build_approximate(const Image &img)
+{
+	//a level on an octave is built into the level itself, the other octaves into scratch
+	std::vector<IntegralHistogram *> octaves;
+	std::vector<bool> owned;
+	for (int l = 0; l < levels(); ++l)
+	{
+		int k = static_cast<int>(std::floor(-std::log(_scales[l]) / std::log(2.0f) + 1e-4f));
+		while (static_cast<int>(octaves.size()) <= k)
+		{
+			octaves.push_back(NULL);
+			owned.push_back(true);
+		}
+		if (std::fabs(_scales[l]*std::pow(2.0f, k) - 1) < 1e-4f)
+		{
+			octaves[k] = _levels[l];
+			owned[k] = false;
+		}
+		else
+			_sources[l] = k;
+	}
+
+	IntegralHistogram::Param octave_param(_inthist_param);
+	if (_param.nthreads > 1)
+		octave_param.nthreads = 1;
+	std::vector<Image> images;
+	for (unsigned int k = 0; k < octaves.size(); ++k)
+	{
+		if (k == 0)
+			images.push_back(img);
+		else
+		{
+			float scale = std::pow(2.0f, -static_cast<float>(k));
+			images.push_back(images.back().get_resize(scaled(_image_width, scale), scaled(_image_height, scale), -100, -100, 2));
+		}
+		if (octaves[k] == NULL)
+			octaves[k] = new IntegralHistogram(octave_param);
+	}
+
+	try
+	{
+		parallel_for_stealing(0, static_cast<int>(octaves.size()), 1, _param.nthreads,
+				boost::bind(&FeaturePyramid::build_levels, this, &images, &octaves, _1, _2));
+		parallel_for_stealing(0, levels(), 1, _param.nthreads, boost::bind(&FeaturePyramid::resample_levels, this, &octaves, _1, _2));
+	}
+	catch (...)
+	{
+		for (unsigned int k = 0; k < octaves.size(); ++k)
+			if (owned[k]) delete octaves[k];
+		throw;
+	}
+	for (unsigned int k = 0; k < octaves.size(); ++k)
+		if (owned[k]) delete octaves[k];
+}
+
+void FeaturePyramid::build_levels(std::vector<Image> *images, std::vector<IntegralHistogram *> *hists, int level_begin, int level_end)
+{
+	for (int l = level_begin; l < level_end; ++l)
+		(*hists)[l]->build((*images)[l]);
+}
+
+void FeaturePyramid::resample_levels(const std::vector<IntegralHistogram *> *octaves, int level_begin, int level_end)
+{
+	for (int l = level_begin; l < level_end; ++l)
+	{
+		if (_sources[l] < 0)
+			continue;
+		float ratio = _scales[l]*std::pow(2.0f, static_cast<float>(_sources[l]));
+		_levels[l]->resample(*(*octaves)[_sources[l]], scaled(_image_width, _scales[l]), scaled(_image_height, _scales[l]),
+				std::pow(ratio, -_param.lambda));
+	}
+}
+
+void FeaturePyramid::extract(float *dscr, size_t stride, const int32_t *windows, int count) const
+{
+	if (stride < static_cast<size_t>(length()))
+		throw std::runtime_error( boost::str(boost::format("Descriptor stride %1% < length %2%") % stride % length()) );
+	parallel_for_stealing(0, count, 64, _hog_param.nthreads, ExtractWindows(dscr, stride, windows, this, &_plans, _hog_param.normalize));
+}
+
+void FeaturePyramid::image_box(int32_t *box, const int32_t *window) const
+{
+	float scale = _scales[window[2]];
+	box[0] = static_cast<int32_t>(window[0] / scale + 0.5f);
+	box[1] = static_cast<int32_t>(window[1] / scale + 0.5f);
+	box[2] = static_cast<int32_t>((window[0] + _param.window_width) / scale + 0.5f) - 1;
+	box[3] = static_cast<int32_t>((window[1] + _param.window_height) / scale + 0.5f) - 1;
+}
+
+void FeaturePyramid::image_box(int32_t *boxes, const int32_t *windows, int count) const
+{
+	for (int k = 0; k < count; ++k)
+		image_box(boxes + 4*k, windows + 3*k);
+}
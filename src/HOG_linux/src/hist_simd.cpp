@@ -0,0 +1,122 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: AVX2 kernels for 8-bin histograms and L2-Hys block normalization.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "hist_simd.h"
+
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HIST_SIMD_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(HIST_SIMD_AVX2)
+
+namespace
+{
+	//p11 - p01 - p10 + p00, optionally divided by the sum of its lanes + eps
+	__attribute__((target("avx2"))) inline __m256 cell(__m256 p11, __m256 p01, __m256 p10, __m256 p00, bool normalize, __m256 eps)
+	{
+		__m256 hist = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(p11, p01), p10), p00);
+		if (!normalize)
+			return hist;
+		//every lane ends up with the same total
+		__m256 sum = _mm256_add_ps(hist, _mm256_permute2f128_ps(hist, hist, 1));
+		sum = _mm256_add_ps(sum, _mm256_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		sum = _mm256_add_ps(sum, _mm256_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm256_div_ps(hist, _mm256_add_ps(sum, eps));
+	}
+
+	__attribute__((target("avx2"))) inline float hsum(__m256 v)
+	{
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+
+	//v *= 1/sqrt(|v|^2 + eps^2), then clipped at clip when clip > 0
+	__attribute__((target("avx2"))) inline void l2_scale(float *v, int n, float clip, float eps)
+	{
+		__m256 acc = _mm256_setzero_ps();
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(v + i);
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(x, x));
+		}
+		float ss = hsum(acc);
+		for (int k = i; k < n; ++k) ss += v[k]*v[k];
+
+		float scale = 1.0f / std::sqrt(ss + eps*eps);
+		const __m256 vscale = _mm256_set1_ps(scale), vclip = _mm256_set1_ps(clip > 0 ? clip : FLT_MAX);
+		for (i = 0; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(v + i, _mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(v + i), vscale), vclip));
+		for (; i < n; ++i) v[i] = std::min(v[i]*scale, clip > 0 ? clip : FLT_MAX);
+	}
+}
+
+bool hist8_avx2_supported()
+{
+	static const bool supported = __builtin_cpu_supports("avx2") && std::getenv("HOG_NO_AVX2") == NULL;
+	return supported;
+}
+
+__attribute__((target("avx2")))
+void hist8_avx2(float *hist, const float *p11, const float *p01, const float *p10, const float *p00, bool normalize, float eps)
+{
+	_mm256_storeu_ps(hist, cell(_mm256_loadu_ps(p11), _mm256_loadu_ps(p01), _mm256_loadu_ps(p10), _mm256_loadu_ps(p00),
+			normalize, _mm256_set1_ps(eps)));
+}
+
+__attribute__((target("avx2")))
+void hist8_column_avx2(float *hist, const float *left, const float *right, int ygrid, bool normalize, float eps)
+{
+	const __m256 veps = _mm256_set1_ps(eps);
+	__m256 p00 = _mm256_loadu_ps(left), p10 = _mm256_loadu_ps(right);
+	for (int j = 0; j < ygrid; ++j, hist += 8)
+	{
+		__m256 p01 = _mm256_loadu_ps(left + (j + 1)*8), p11 = _mm256_loadu_ps(right + (j + 1)*8);
+		_mm256_storeu_ps(hist, cell(p11, p01, p10, p00, normalize, veps));
+		p00 = p01;
+		p10 = p11;
+	}
+}
+
+__attribute__((target("avx2")))
+void l2hys_avx2(float *blocks, int count, int n, float clip, float eps)
+{
+	for (int b = 0; b < count; ++b, blocks += n)
+	{
+		l2_scale(blocks, n, clip, eps);
+		l2_scale(blocks, n, 0, eps);
+	}
+}
+
+#else
+
+bool hist8_avx2_supported()
+{
+	return false;
+}
+
+void hist8_avx2(float *, const float *, const float *, const float *, const float *, bool, float)
+{
+	std::abort();
+}
+
+void hist8_column_avx2(float *, const float *, const float *, int, bool, float)
+{
+	std::abort();
+}
+
+void l2hys_avx2(float *, int, int, float, float)
+{
+	std::abort();
+}
+
+#endif
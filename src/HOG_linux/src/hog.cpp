@@ -38,6 +38,8 @@
 #include "integral_histogram.h"
 #include "hog_extractor.h"
 #include "hog_wrappers.h"
+#include "quantized.h"
+#include "feature_pyramid.h"
 
 void help_exit(const char *app_name)
 {
@@ -47,38 +49,19 @@ void help_exit(const char *app_name)
 		<< "\t-k \t key point file, default:random sampling\n"
 		<< "\t-d \t sampling density: 1/grid_size\n"
 		<< "\t-p \t patch size\n"
+		<< "\t-s \t dense mode: windows every s cells of size patch_size/grid, key points are ignored\n"
+		<< "\t-b \t dense mode block size, cells are L2-Hys normalized in overlapping b x b blocks\n"
+		<< "\t-t \t number of threads, default 1\n"
+		<< "\t-l \t pyramid mode: levels scaled by 1/l, windows every cell on each level, key points are ignored\n"
+		<< "\t-m \t multi-scale mode on one integral histogram: windows and cells grow by m per scale, not with -l\n"
+		<< "\t-g \t grid cells per side, default 4\n"
+		<< "\t-q \t write 8-bit components round(255*v) instead of floats\n"
 		<< "\t-h \t display this message\n";
 	exit(1);
 }
 
-
-void test()
-{
-  std::cout << "In test\n";
-  ublas::matrix<int> bbox(1, 4);
-  int patch_size = 64;
-  int x = 50;
-  int y = 50;                                                                         
-  bbox(0, 0) = x - patch_size/2;
-  bbox(0, 1) = y - patch_size/2;
-  bbox(0, 2) = x + patch_size/2;
-  bbox(0, 3) = y + patch_size/2;
-  const char* fin = "test.jpg";
-  std::cout<< "calling extract hog features\n";
-  ublas::matrix<float> dscr = extract_hog_features(bbox,fin);
-  std::cout <<"dscr size is"<<dscr.size2();
-  for (int i = 0; i < dscr.size2();++i)
-    {
-      std::cout<< dscr(0,i)<<"\n";
-    }
-}
-
 int main( int argc, char *argv[] )
 {
- 
-  test();
-  return 0;
- 
 	IntegralHistogram::Param inthist_param;
 	inthist_param.dirnum = 8;
 	inthist_param.exp = 1;
@@ -96,9 +79,14 @@ int main( int argc, char *argv[] )
 
 	float kp_density = 1.0/8.0; // 1/grid_size
 	int patch_size = 32;
+	int stride = 0; //dense mode when > 0
+	int block = 0; //dense mode block normalization when > 0
+	bool quantize = false;
+	float scale_step = 0; //pyramid mode when > 1
+	float grid_step = 0; //multi-scale mode when > 1
 
 	int c;
-	while ((c = getopt(argc, argv, "i:o:k:d:p:h")) != -1)
+	while ((c = getopt(argc, argv, "i:o:k:d:p:s:b:t:l:m:g:qh")) != -1)
 	{
 		switch (c)
 		{
@@ -117,6 +105,27 @@ int main( int argc, char *argv[] )
 		case 'p':
 			patch_size = boost::lexical_cast<int>(optarg);
 			break;
+		case 's':
+			stride = boost::lexical_cast<int>(optarg);
+			break;
+		case 'b':
+			block = boost::lexical_cast<int>(optarg);
+			break;
+		case 't':
+			inthist_param.nthreads = hog_param.nthreads = boost::lexical_cast<int>(optarg);
+			break;
+		case 'l':
+			scale_step = boost::lexical_cast<float>(optarg);
+			break;
+		case 'm':
+			grid_step = boost::lexical_cast<float>(optarg);
+			break;
+		case 'g':
+			hog_param.xgrid = hog_param.ygrid = boost::lexical_cast<int>(optarg);
+			break;
+		case 'q':
+			quantize = true;
+			break;
 		case 'h':
 			help_exit(argv[0]);
 			break;
@@ -131,13 +140,94 @@ int main( int argc, char *argv[] )
 		help_exit(argv[0]);
 	}
 
+	if (scale_step > 1 && grid_step > 1)
+	{
+		std::cerr << "-l and -m can not be combined\n";
+		help_exit(argv[0]);
+	}
+
 	Image im( fin );
 	IntegralHistogram inthist(inthist_param);
-	inthist.build(im);
+	if (scale_step <= 1)
+		inthist.build(im);
 
 	std::vector <int> kp_list[2];
+	std::vector <int> size_list;   //window sizes in the image, pyramid and multi-scale modes
+	ublas::matrix<float> dscr;
+	ublas::matrix<int> bbox;
+	HOGExtractor extr(hog_param);
 	
-	if (fkp != 0) //read keypoints from file
+	if (grid_step > 1) //multi-scale mode, one window size per scale on the same histogram
+	{
+		int cell = std::max(patch_size / std::max(hog_param.xgrid, hog_param.ygrid), 1);
+		std::vector<float> windows;
+		for (float scale = 1; patch_size*scale <= std::min(inthist.width(), inthist.height()); scale *= grid_step)
+			for (float y = 0; y + patch_size*scale <= inthist.height(); y += cell*scale)
+				for (float x = 0; x + patch_size*scale <= inthist.width(); x += cell*scale)
+				{
+					windows.push_back(x);
+					windows.push_back(y);
+					windows.push_back(scale);
+				}
+		int count = static_cast<int>(windows.size() / 3);
+		dscr.resize(count, hog_param.xgrid * hog_param.ygrid * inthist_param.dirnum);
+		if (count > 0)
+			extr.extract_scaled(&dscr(0, 0), dscr.size2(), &windows[0], count, patch_size, patch_size, FeaturePyramid::default_lambda, inthist);
+		for (int k = 0; k < count; ++k)
+		{
+			int size = static_cast<int>(patch_size*windows[3*k + 2] + 0.5f);
+			kp_list[0].push_back(static_cast<int>(windows[3*k] + 0.5f) + size/2);
+			kp_list[1].push_back(static_cast<int>(windows[3*k + 1] + 0.5f) + size/2);
+			size_list.push_back(size);
+		}
+	}
+	else if (scale_step > 1) //pyramid mode
+	{
+		FeaturePyramid::Param pyramid_param(scale_step, patch_size, patch_size, 0, hog_param.nthreads);
+		FeaturePyramid pyramid(pyramid_param, inthist_param, hog_param);
+		pyramid.build(im);
+		int cell = std::max(patch_size / std::max(hog_param.xgrid, hog_param.ygrid), 1);
+		std::vector<int32_t> windows;
+		for (int l = 0; l < pyramid.levels(); ++l)
+			for (int y = 0; y + patch_size <= pyramid.level(l).height(); y += cell)
+				for (int x = 0; x + patch_size <= pyramid.level(l).width(); x += cell)
+				{
+					windows.push_back(x);
+					windows.push_back(y);
+					windows.push_back(l);
+				}
+		int count = static_cast<int>(windows.size() / 3);
+		dscr.resize(count, pyramid.length());
+		if (count > 0)
+			pyramid.extract(&dscr(0, 0), dscr.size2(), &windows[0], count);
+		for (int k = 0; k < count; ++k)
+		{
+			int32_t box[4];
+			pyramid.image_box(box, &windows[3*k]);
+			kp_list[0].push_back((box[0] + box[2] + 1)/2);
+			kp_list[1].push_back((box[1] + box[3] + 1)/2);
+			size_list.push_back(box[2] - box[0] + 1);
+		}
+	}
+	else if (stride > 0) //dense mode, every cell histogram is computed once
+	{
+		CellMap cells;
+		cells.build(inthist, patch_size / std::max(hog_param.xgrid, hog_param.ygrid), hog_param.normalize && block <= 0, hog_param.nthreads);
+		if (block > 0)
+		{
+			BlockMap blocks;
+			blocks.build(cells, block, 0.2f, hog_param.nthreads);
+			extr.extract_dense(dscr, bbox, blocks, stride);
+		}
+		else
+			extr.extract_dense(dscr, bbox, cells, stride);
+		for (unsigned int i = 0; i < bbox.size1(); ++i)
+		{
+			kp_list[0].push_back((bbox(i, 0) + bbox(i, 2) + 1)/2);
+			kp_list[1].push_back((bbox(i, 1) + bbox(i, 3) + 1)/2);
+		}
+	}
+	else if (fkp != 0) //read keypoints from file
 	{
 		std::fstream kp_ins(fkp, std::ios::in);
 		if (!kp_ins.is_open())
@@ -170,24 +260,26 @@ int main( int argc, char *argv[] )
 		}
 	}
 
-	ublas::matrix<float> dscr(kp_list[0].size(), hog_param.xgrid * hog_param.ygrid * inthist_param.dirnum);
-	ublas::matrix<int> bbox(kp_list[0].size(), 4);
+	if (grid_step <= 1 && scale_step <= 1 && stride <= 0)
+	{
+		dscr.resize(kp_list[0].size(), hog_param.xgrid * hog_param.ygrid * inthist_param.dirnum);
+		bbox.resize(kp_list[0].size(), 4);
 	
-	//std::cout << kp_list[0].size();
+		//std::cout << kp_list[0].size();
 
-	for (unsigned int i = 0; i < kp_list[0].size(); ++i)
-	{
-		bbox(i, 0) = kp_list[0][i] - patch_size/2;
-		bbox(i, 1) = kp_list[1][i] - patch_size/2;
-		bbox(i, 2) = kp_list[0][i] + patch_size/2;
-		bbox(i, 3) = kp_list[1][i] + patch_size/2;
+		for (unsigned int i = 0; i < kp_list[0].size(); ++i)
+		{
+			bbox(i, 0) = kp_list[0][i] - patch_size/2;
+			bbox(i, 1) = kp_list[1][i] - patch_size/2;
+			bbox(i, 2) = kp_list[0][i] + patch_size/2;
+			bbox(i, 3) = kp_list[1][i] + patch_size/2;
+		}
+		for (int i = 0; i < kp_list[0].size();++i)
+		  {
+		    std::cout << bbox(i,0) <<"\t" << bbox(i,1) << "\t" << bbox(i,2) << "\t" << bbox(i,3)<<"\n";
+		  }
+		extr.extract(dscr, bbox, inthist);
 	}
-	for (int i = 0; i < kp_list[0].size();++i)
-	  {
-	    std::cout << bbox(i,0) <<"\t" << bbox(i,1) << "\t" << bbox(i,2) << "\t" << bbox(i,3)<<"\n";
-	  }
-	HOGExtractor extr(hog_param);
-	extr.extract(dscr, bbox, inthist);
 
 	std::streambuf *cout_buf_old = std::cout.rdbuf();
 	std::fstream outs;
@@ -202,12 +294,20 @@ int main( int argc, char *argv[] )
 		std::cout.rdbuf(outs.rdbuf());
 	}
 	std::cout << dscr.size2() << "\n" << dscr.size1() << "\n";
+	std::vector<uint8_t> q(dscr.size2());
 	for (unsigned int i = 0; i < kp_list[0].size(); ++i)
 	{
-		std::cout << kp_list[0][i] << " " << kp_list[1][i] << " " << patch_size << " ";
-		for (unsigned int j = 0; j < dscr.size2(); ++j)
+		std::cout << kp_list[0][i] << " " << kp_list[1][i] << " " << (size_list.empty() ? patch_size : size_list[i]) << " ";
+		if (quantize)
+		{
+			quantize_u8(&q[0], &dscr(i, 0), static_cast<int>(dscr.size2()));
+			for (unsigned int j = 0; j < dscr.size2(); ++j)
+				std::cout << static_cast<int>(q[j]) << " ";
+		}
+		else
 		{
-			std::cout << dscr(i, j) << " ";
+			for (unsigned int j = 0; j < dscr.size2(); ++j)
+				std::cout << dscr(i, j) << " ";
 		}
 		std::cout << "\n";
 	}
@@ -38,15 +38,280 @@
 
 
 #include "hog_extractor.h"
+#include "parallel.h"
+#include "quantized.h"
 
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/numeric/ublas/vector.hpp>
 #include <boost/format.hpp>
 #include <stdexcept>
+#include <vector>
+#include <cmath>
 
 using namespace boost::numeric;
 
-//extract HOG features from a group of key points
+namespace
+{
+	//a window of a CellMap or BlockMap is nx x ny map elements of unit floats, the ny elements of
+	//each of its columns are adjacent in the map; dscr points into a row of a row major matrix
+	template<typename Map>
+	inline void gather(float *dscr, const Map &map, int cx, int cy, int nx, int ny, int unit)
+	{
+		for (int i = 0; i < nx; ++i)
+		{
+			const float *hist = map.hist(cx + i, cy);
+			dscr = std::copy(hist, hist + ny*unit, dscr);
+		}
+	}
+
+	//windows given by their top-left map element [cx cy]
+	template<typename Map>
+	void extract_map(ublas::matrix<float> &dscr_list, const ublas::matrix<int> &cell_list, const Map &map, int nx, int ny, int unit)
+	{
+		unsigned int length = nx * ny * unit;
+		if (dscr_list.size1() != cell_list.size1() || dscr_list.size2() != length || cell_list.size2() != 2)
+			throw std::runtime_error( boost::str(
+						boost::format("Allocate proper memory for dscr_list [%1% %2%] != [%3% %4%]") % dscr_list.size1() % dscr_list.size2() % cell_list.size1() % length) );
+
+		for (unsigned int k = 0; k < cell_list.size1(); ++k)
+		{
+			int cx = cell_list(k, 0), cy = cell_list(k, 1);
+			if ( cx < 0 || cy < 0 || cx + nx > map.cols() || cy + ny > map.rows() )
+				throw std::runtime_error( boost::str(boost::format("Invalid cell window [%1% %2%] in %3%x%4% map") % cx % cy % map.cols() % map.rows()) );
+			gather(&dscr_list(k, 0), map, cx, cy, nx, ny, unit);
+		}
+	}
+
+	//every window on a stride x stride lattice, row by row; the boxes span xgrid x ygrid cells
+	template<typename Map>
+	void extract_map_dense(ublas::matrix<float> &dscr_list, ublas::matrix<int> &bbox_list, const Map &map, int nx, int ny, int unit,
+			int xgrid, int ygrid, int stride)
+	{
+		if (stride < 1)
+			throw std::runtime_error( boost::str(boost::format("Invalid stride %1%") % stride) );
+
+		int wx = map.cols() >= nx ? (map.cols() - nx)/stride + 1 : 0;
+		int wy = map.rows() >= ny ? (map.rows() - ny)/stride + 1 : 0;
+		dscr_list.resize(wx*wy, nx * ny * unit, false);
+		bbox_list.resize(wx*wy, 4, false);
+		for (int y = 0, k = 0; y < wy; ++y)
+			for (int x = 0; x < wx; ++x, ++k)
+			{
+				int cx = x*stride, cy = y*stride;
+				gather(&dscr_list(k, 0), map, cx, cy, nx, ny, unit);
+				bbox_list(k, 0) = cx*map.cell();
+				bbox_list(k, 1) = cy*map.cell();
+				bbox_list(k, 2) = (cx + xgrid)*map.cell() - 1;
+				bbox_list(k, 3) = (cy + ygrid)*map.cell() - 1;
+			}
+	}
+
+	//rows [row_begin, row_end) of a bbox list, box k at bbox + k*bbox_stride and its descriptor at
+	//dscr + k*stride; the path of a row only depends on its box, so any split of the list over
+	//threads gives the same descriptors. Copies own their grid scratch and plan
+	struct ExtractRows
+	{
+		float *dscr;
+		size_t stride;
+		const int32_t *bbox;
+		size_t bbox_stride;
+		const IntegralHistogram *inthist;
+		HOGExtractor::Param param;
+		std::vector<int> grid;
+		std::vector<ExtractionPlan> plan;   //at most one, for the size of the last planned box
+		ExtractRows(float *d, size_t s, const int32_t *b, size_t bs, const IntegralHistogram &h, const HOGExtractor::Param &p)
+			:dscr(d),stride(s),bbox(b),bbox_stride(bs),inthist(&h),param(p){}
+
+		//windows inside the image go through a plan; a new size replans in place, which costs
+		//about the grid_lines call it replaces, so lists of random sizes do not pay for it
+		inline bool planned(const int32_t *box)
+		{
+			int width = box[2] - box[0] + 1, height = box[3] - box[1] + 1;
+			if (box[0] < 0 || box[1] < 0 || box[2] >= inthist->width() || box[3] >= inthist->height()
+					|| width <= param.xgrid || height <= param.ygrid)
+				return false;
+			if (plan.empty())
+				plan.push_back(ExtractionPlan(*inthist, width, height, param.xgrid, param.ygrid));
+			else
+				plan[0].resize(width, height);
+			return true;
+		}
+
+		void operator()(int row_begin, int row_end)
+		{
+			int stack_grid[64];
+			int *xs = stack_grid;
+			if (param.xgrid + param.ygrid + 2 > 64)
+			{
+				grid.resize( param.xgrid + param.ygrid + 2 );
+				xs = &grid[0];
+			}
+			int *ys = xs + param.xgrid + 1;
+
+			const bool fixed8 = inthist->dirnum() == 8 && param.xgrid == 4 && param.ygrid == 4;
+			const bool fixed9 = inthist->dirnum() == 9 && param.xgrid == 8 && param.ygrid == 16;
+			for (int k = row_begin; k < row_end; ++k)
+			{
+				const int32_t *box = bbox + k*bbox_stride;
+				float *out = dscr + k*stride;
+				if (fixed8)
+					FixedHOGExtractor<8, 4, 4>::extract(out, box, *inthist, param.normalize);
+				else if (fixed9)
+					FixedHOGExtractor<9, 8, 16>::extract(out, box, *inthist, param.normalize);
+				else if (planned(box))
+					plan[0].extract(out, box[0], box[1], param.normalize);
+				else
+				{
+					HOGExtractor::grid_lines(xs, ys, box, inthist->width(), inthist->height(), param.xgrid, param.ygrid);
+					inthist->get_window_hist_unchecked(out, xs, param.xgrid, ys, param.ygrid, param.normalize);
+				}
+			}
+		}
+	};
+
+	//windows [x y scale] as boxes of the base window width x height, through ExtractRows so that
+	//the windows of a scale share a plan
+	struct ExtractScaled
+	{
+		float *dscr;
+		size_t stride;
+		const float *windows;
+		int width;
+		int height;
+		float lambda;
+		ExtractRows rows;
+		std::vector<int32_t> boxes;
+		ExtractScaled(float *d, size_t s, const float *w, int ww, int wh, float la, const IntegralHistogram &h, const HOGExtractor::Param &p)
+			:dscr(d),stride(s),windows(w),width(ww),height(wh),lambda(la),rows(d, s, 0, 4, h, p){}
+
+		void operator()(int row_begin, int row_end)
+		{
+			int n = row_end - row_begin;
+			boxes.resize(4*n);
+			for (int k = 0; k < n; ++k)
+			{
+				const float *window = windows + 3*(row_begin + k);
+				boxes[4*k] = static_cast<int32_t>(std::floor(window[0] + 0.5f));
+				boxes[4*k + 1] = static_cast<int32_t>(std::floor(window[1] + 0.5f));
+				boxes[4*k + 2] = static_cast<int32_t>(std::floor(window[0] + width*window[2] + 0.5f)) - 1;
+				boxes[4*k + 3] = static_cast<int32_t>(std::floor(window[1] + height*window[2] + 0.5f)) - 1;
+			}
+			rows.dscr = dscr + row_begin*stride;
+			rows.bbox = &boxes[0];
+			rows(0, n);
+			if (rows.param.normalize)
+				return;
+
+			int length = rows.param.xgrid * rows.param.ygrid * rows.inthist->dirnum();
+			for (int k = 0; k < n; ++k)
+			{
+				float gain = std::pow(windows[3*(row_begin + k) + 2], lambda - 2);
+				float *out = dscr + (row_begin + k)*stride;
+				for (int j = 0; j < length; ++j) out[j] *= gain;
+			}
+		}
+	};
+
+	inline void store(uint8_t *q, const float *v, int n) { quantize_u8(q, v, n); }
+	inline void store(uint16_t *h, const float *v, int n) { float_to_half(h, v, n); }
+
+	//ExtractRows into a float scratch of one chunk, stored as T; the plan carries over chunks
+	template<typename T>
+	struct QuantizeRows
+	{
+		T *dscr;
+		size_t stride;
+		const int32_t *bbox;
+		int length;
+		ExtractRows rows;
+		std::vector<float> scratch;
+		QuantizeRows(T *d, size_t s, const int32_t *b, const IntegralHistogram &h, const HOGExtractor::Param &p, int len)
+			:dscr(d),stride(s),bbox(b),length(len),rows(0, len, b, 4, h, p){}
+
+		void operator()(int row_begin, int row_end)
+		{
+			int n = row_end - row_begin;
+			scratch.resize( static_cast<size_t>(n)*length );
+			rows.dscr = &scratch[0];
+			rows.bbox = bbox + row_begin*4;
+			rows(0, n);
+			for (int k = 0; k < n; ++k)
+				store(dscr + (row_begin + k)*stride, &scratch[k*length], length);
+		}
+	};
+}
+
+ExtractionPlan::ExtractionPlan(const IntegralHistogram &inthist, int width, int height, int xgrid, int ygrid)
+	:_inthist(&inthist),_width(0),_height(0),_xgrid(xgrid),_ygrid(ygrid),_dirnum(inthist.dirnum()),
+	_image_width(inthist.width()),_image_height(inthist.height()),_grid(xgrid + ygrid + 2),_offsets((xgrid + 1)*(ygrid + 1))
+{
+	resize(width, height);
+}
+
+void ExtractionPlan::resize(int width, int height)
+{
+	if (width == _width && height == _height)
+		return;
+	_width = width;
+	_height = height;
+	int box[4] = {0, 0, width - 1, height - 1};
+	int *xs = &_grid[0], *ys = xs + _xgrid + 1;
+	HOGExtractor::grid_lines(xs, ys, box, width, height, _xgrid, _ygrid);
+	for (int i = 0; i <= _xgrid; ++i)
+		for (int j = 0; j <= _ygrid; ++j)
+			_offsets[i*(_ygrid + 1) + j] = _inthist->offset(xs[i], ys[j]);
+}
+
+//extract HOG features from a flat box array into aligned rows
+void HOGExtractor::extract(float *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist)
+{
+	if (reinterpret_cast<size_t>(dscr) % 64 != 0 || stride*sizeof(float) % 64 != 0)
+		throw std::runtime_error( boost::str(boost::format("Descriptor rows are not 64-byte aligned [%1% stride %2%]") % dscr % stride) );
+	if (stride < static_cast<size_t>(length(inthist.dirnum())))
+		throw std::runtime_error( boost::str(boost::format("Descriptor stride %1% < length %2%") % stride % length(inthist.dirnum())) );
+
+	extract_rows(dscr, stride, bbox, 4, count, inthist);
+}
+
+void HOGExtractor::extract_scaled(float *dscr, size_t stride, const float *windows, int count, int width, int height, float lambda, const IntegralHistogram &inthist)
+{
+	if (stride < static_cast<size_t>(length(inthist.dirnum())))
+		throw std::runtime_error( boost::str(boost::format("Descriptor stride %1% < length %2%") % stride % length(inthist.dirnum())) );
+	for (int k = 0; k < count; ++k)
+		if (!(windows[3*k + 2] > 0))
+			throw std::runtime_error( boost::str(boost::format("Invalid window scale %1%") % windows[3*k + 2]) );
+	parallel_for_stealing(0, count, 64, _param.nthreads, ExtractScaled(dscr, stride, windows, width, height, lambda, inthist, _param));
+}
+
+//quantized outputs: extract chunks of 64 rows as float, then round them into T
+template<typename T>
+void HOGExtractor::extract_quantized(T *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist)
+{
+	int len = length(inthist.dirnum());
+	if (stride < static_cast<size_t>(len))
+		throw std::runtime_error( boost::str(boost::format("Descriptor stride %1% < length %2%") % stride % len) );
+	parallel_for_stealing(0, count, 64, _param.nthreads, QuantizeRows<T>(dscr, stride, bbox, inthist, _param, len));
+}
+
+void HOGExtractor::extract(uint8_t *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist)
+{
+	if (!_param.normalize)
+		throw std::runtime_error("8-bit descriptors need normalized cell histograms");
+	extract_quantized(dscr, stride, bbox, count, inthist);
+}
+
+void HOGExtractor::extract(uint16_t *dscr, size_t stride, const int32_t *bbox, int count, const IntegralHistogram &inthist)
+{
+	extract_quantized(dscr, stride, bbox, count, inthist);
+}
+
+void HOGExtractor::extract_rows(float *dscr, size_t stride, const int32_t *bbox, size_t bbox_stride, int count, const IntegralHistogram &inthist)
+{
+	//blocks of 64 windows keep the scheduling overhead far below the extraction cost
+	parallel_for_stealing(0, count, 64, _param.nthreads, ExtractRows(dscr, stride, bbox, bbox_stride, inthist, _param));
+}
+
+//extract HOG features from a group of key points, an adapter over extract_rows
 void HOGExtractor::extract(ublas::matrix<float> &dscr_list, const ublas::matrix<int> &bbox_list, const IntegralHistogram &inthist)
 {
 	unsigned int length = _param.xgrid * _param.ygrid * inthist.dirnum();
@@ -54,32 +319,11 @@ void HOGExtractor::extract(ublas::matrix<float> &dscr_list, const ublas::matrix<
 		throw std::runtime_error( boost::str(
 					boost::format("Allocate proper memory for dscr_list [%1% %2%] != [%3% %4%]") % dscr_list.size1() % dscr_list.size2() % dscr_list.size2() % length) );
 
-	ublas::matrix<float>::iterator1 idscr_list;
-	ublas::matrix<int>::const_iterator1 ibbox_list;
-	ublas::matrix<int>::const_iterator1 ibbox_list_end(bbox_list.end1());
-	ublas::vector<int> bbox_grids( _param.xgrid * _param.ygrid * 4 );
-	for ( ibbox_list = bbox_list.begin1(), idscr_list = dscr_list.begin1(); ibbox_list != ibbox_list_end; ++ibbox_list, ++idscr_list)
-	{
-		ublas::matrix<int>::const_iterator2 ibbox = ibbox_list.begin();
-		float x0 = std::max( *ibbox++, 0 );
-		float y0 = std::max( *ibbox++, 0 );
-		float x1 = std::min( *ibbox++, inthist.width() - 1 );
-		float y1 = std::min( *ibbox++, inthist.height() - 1 );
-		if ( x1 - x0 < _param.xgrid || y1 - y0 < _param.ygrid )
-			throw std::runtime_error( boost::str(boost::format("Grid number should be less than bbox width/height [%1% %2% %3% %4%]/[%5% %6%]") % x0 % y0 % x1 % y1 % _param.xgrid % _param.ygrid) );
-
-		float xstep = (x1 - x0 + 1) / _param.xgrid;
-		float ystep = (y1 - y0 + 1) / _param.ygrid;
-		for (int i = 0; i < _param.xgrid; ++i)
-			for (int j = 0; j < _param.ygrid; ++j)
-			{
-				bbox_grids( (i * _param.ygrid + j)*4 + 0) = static_cast<int>(x0 + xstep*i);    //x0 
-				bbox_grids( (i * _param.ygrid + j)*4 + 1) = static_cast<int>(y0 + ystep*j);    //y0 
-				bbox_grids( (i * _param.ygrid + j)*4 + 2) = static_cast<int>(x0 + xstep*(i + 1) - 1);    //x1 
-				bbox_grids( (i * _param.ygrid + j)*4 + 3) = static_cast<int>(y0 + ystep*(j + 1) - 1);    //y1 
-			}
-		inthist.get_hist< ublas::matrix<float>::iterator2, ublas::vector<int>::const_iterator>( idscr_list.begin(), bbox_grids.begin(), bbox_grids.end(), _param.normalize);
-	}
+	if (bbox_list.size1() > 0 && bbox_list.size2() < 4)
+		throw std::runtime_error( boost::str(boost::format("Invalid bbox_list [%1% %2%]") % bbox_list.size1() % bbox_list.size2()) );
+
+	if (bbox_list.size1() > 0)
+		extract_rows(&dscr_list(0, 0), dscr_list.size2(), &bbox_list(0, 0), bbox_list.size2(), static_cast<int>(bbox_list.size1()), inthist);
 }
 
 //extract HOG feature from one key point
@@ -89,27 +333,45 @@ void HOGExtractor::extract(ublas::vector<float> &dscr,  const ublas::vector<int>
 	if (dscr.size() != length)
 		throw std::runtime_error( boost::str(boost::format("Allocate proper memory for dscr [%1%] != [%2%]") % dscr.size() % length) );
 
-	inthist.get_hist< ublas::vector<float>::iterator, ublas::vector<int>::const_iterator>( dscr.begin(), bbox.begin(), bbox.end() );
+	if (bbox.size() != 4)
+		throw std::runtime_error( boost::str(boost::format("Invalid bbox [%1%]") % bbox.size()) );
 
-	ublas::vector<int> bbox_grids( _param.xgrid * _param.ygrid * 4 );
-	ublas::vector<int>::const_iterator ibbox = bbox.begin();
-	float x0 = std::max( *ibbox++, 0 );
-	float y0 = std::max( *ibbox++, 0 );
-	float x1 = std::min( *ibbox++, inthist.width() - 1 );
-	float y1 = std::min( *ibbox++, inthist.height() - 1 );
+	//the box must lie inside the image, as for IntegralHistogram::get_hist
+	if (bbox(0) < 0 || bbox(1) < 0 || bbox(0) > bbox(2) || bbox(1) > bbox(3) || bbox(2) >= inthist.width() || bbox(3) >= inthist.height())
+		throw std::runtime_error( boost::str(boost::format("Invalid index [%1% %2% %3% %4%]") % bbox(0) % bbox(1) % bbox(2) % bbox(3)) );
 
-	if ( x1 - x0 < _param.xgrid || y1 - y0 < _param.ygrid )
-		throw std::runtime_error( boost::str(boost::format("Grid number should be less than bbox width/height [%1% %2% %3% %4%]/[%5% %6%]") % x0 % y0 % x1 % y1 % _param.xgrid % _param.ygrid) );
+	extract_rows(&dscr(0), length, &bbox(0), 4, 1, inthist);
+}
 
-	float xstep = (x1 - x0 + 1) / _param.xgrid;
-	float ystep = (y1 - y0 + 1) / _param.ygrid;
-	for (int i = 0; i < _param.xgrid; ++i)
-		for (int j = 0; j < _param.ygrid; ++j)
-		{
-			bbox_grids( (i * _param.ygrid + j)*4 + 0) = static_cast<int>(x0 + xstep*i);    //x0 
-			bbox_grids( (i * _param.ygrid + j)*4 + 1) = static_cast<int>(y0 + ystep*j);    //y0 
-			bbox_grids( (i * _param.ygrid + j)*4 + 2) = static_cast<int>(x0 + xstep*(i + 1) - 1);    //x1 
-			bbox_grids( (i * _param.ygrid + j)*4 + 3) = static_cast<int>(y0 + ystep*(j + 1) - 1);    //y1 
-		}
-	inthist.get_hist< ublas::vector<float>::iterator, ublas::vector<int>::const_iterator>( dscr.begin(), bbox_grids.begin(), bbox_grids.end(), _param.normalize);
+//extract HOG features of windows aligned to a cell map
+void HOGExtractor::extract(ublas::matrix<float> &dscr_list, const ublas::matrix<int> &cell_list, const CellMap &cells)
+{
+	extract_map(dscr_list, cell_list, cells, _param.xgrid, _param.ygrid, cells.dirnum());
+}
+
+//extract HOG features of all windows of a cell map on a stride x stride lattice
+void HOGExtractor::extract_dense(ublas::matrix<float> &dscr_list, ublas::matrix<int> &bbox_list, const CellMap &cells, int stride)
+{
+	extract_map_dense(dscr_list, bbox_list, cells, _param.xgrid, _param.ygrid, cells.dirnum(), _param.xgrid, _param.ygrid, stride);
+}
+
+//extract block normalized HOG features of windows aligned to a block map
+void HOGExtractor::extract(ublas::matrix<float> &dscr_list, const ublas::matrix<int> &cell_list, const BlockMap &blocks)
+{
+	check_blocks(blocks);
+	extract_map(dscr_list, cell_list, blocks, _param.xgrid - blocks.block() + 1, _param.ygrid - blocks.block() + 1, blocks.length());
+}
+
+//extract block normalized HOG features of all windows of a block map on a stride x stride lattice
+void HOGExtractor::extract_dense(ublas::matrix<float> &dscr_list, ublas::matrix<int> &bbox_list, const BlockMap &blocks, int stride)
+{
+	check_blocks(blocks);
+	extract_map_dense(dscr_list, bbox_list, blocks, _param.xgrid - blocks.block() + 1, _param.ygrid - blocks.block() + 1, blocks.length(),
+			_param.xgrid, _param.ygrid, stride);
+}
+
+void HOGExtractor::check_blocks(const BlockMap &blocks) const
+{
+	if ( blocks.block() > _param.xgrid || blocks.block() > _param.ygrid )
+		throw std::runtime_error( boost::str(boost::format("Block size %1% does not fit the %2%x%3% grid") % blocks.block() % _param.xgrid % _param.ygrid) );
 }
@@ -32,107 +32,350 @@
 
 
 #include "integral_histogram.h"
+#include "orientation_binning.h"
+#include "parallel.h"
 #include "image.h"
 
-IntegralHistogram::IntegralHistogram(hist_type htype, int dirnum, float exp, float sigma)
-{
-	_param.htype = htype;
-	_param.dirnum = dirnum;
-	_param.exp = exp;
-	_param.sigma = sigma;
+#include <vector>
+#include <algorithm>
+
+const float IntegralHistogramBase::eps = 1e-10;
 
+template<typename Layout>
+BasicIntegralHistogram<Layout>::BasicIntegralHistogram(hist_type htype, int dirnum, float exp, float sigma): IntegralHistogramBase(Param(htype, dirnum, exp, sigma))
+{
 	_inthist = NULL;
 }
 
-IntegralHistogram::IntegralHistogram(Param &param): _param(param)
+template<typename Layout>
+BasicIntegralHistogram<Layout>::BasicIntegralHistogram(Param &param): IntegralHistogramBase(param)
 {
 	_inthist = NULL;
 }
 
-IntegralHistogram::~IntegralHistogram()
+template<typename Layout>
+BasicIntegralHistogram<Layout>::~BasicIntegralHistogram()
 {
 	delete[] _inthist;
 	_inthist = NULL;
 }
 
 //calculate integral histogram for img, img will be modified
-void IntegralHistogram::build( Image & img )
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::build( Image & img )
 {
-	const float PI = std::atan2(0, -1);
 	_width = static_cast<int>(img.dimx());
 	_height = static_cast<int>(img.dimy());
-	_inthist = new float[_width*_height*_param.dirnum];
+	allocate();
 	img.blur( _param.sigma );
 
-	//[-1 0 1], [-1 0 1]';
-	Image hmask(3, 1), vmask(1, 3);
-	hmask(0, 0) = vmask(0, 0) = -1;
-	hmask(1, 0) = vmask(0, 1) = 0;
-	hmask(2, 0) = vmask(0, 2) = 1;
-
-	Image vmasked = img.get_convolve( vmask );
-	Image &hmasked = img.convolve( hmask );
-
-	Image angle(_width, _height);
-	if (_param.htype == directed)
-		for (int i = 0; i < _width*_height; ++i) angle[i] = std::atan2(vmasked[i], hmasked[i]) + PI;
-	else //undirected
-		for (int i = 0; i < _width*_height; ++i) {angle[i] = std::atan(vmasked[i] / (hmasked[i] + eps)) + PI/2;}
-		
-	hmasked.mul(hmasked) += vmasked.get_mul(vmasked);
-	Image &mod = hmasked;
+	OrientationBinning *binning = new_binning();
+	if (_param.streaming)
+	{
+		//the vertical pass is fused into the row loop when a single band covers the image
+		bool fused = std::min(_param.nthreads, _height) <= 1;
+		parallel_for(0, _height, _param.nthreads,
+				boost::bind(&BasicIntegralHistogram::build_rows, this, boost::cref(img), binning, _1, _2, fused));
+		if (!fused)
+			parallel_for(0, _width, _param.nthreads, boost::bind(&BasicIntegralHistogram::integrate_columns, this, _1, _2));
+	}
+	else
+	{
+		//[-1 0 1], [-1 0 1]';
+		Image hmask(3, 1), vmask(1, 3);
+		hmask(0, 0) = vmask(0, 0) = -1;
+		hmask(1, 0) = vmask(0, 1) = 0;
+		hmask(2, 0) = vmask(0, 2) = 1;
+
+		Image vmasked = img.get_convolve( vmask );
+		Image &hmasked = img.convolve( hmask );
+		Image mod(_width, _height);
+		magnitude(mod.ptr(), hmasked.ptr(), vmasked.ptr(), _width*_height);
+		std::vector<float> row(Layout::planar ? _width*_param.dirnum : 0);
+		for (int i = 0; i < _height; ++i)
+		{
+			if (Layout::planar)
+			{
+				bin(binning, &row[0], hmasked.ptr(0, i), vmasked.ptr(0, i), mod.ptr(0, i), _width);
+				store_row(i, &row[0], false, false);
+			}
+			else
+				bin(binning, _inthist + index(0, i, 0), hmasked.ptr(0, i), vmasked.ptr(0, i), mod.ptr(0, i), _width);
+		}
+		integrate();
+	}
+	delete binning;
+}
+
+//storage for _width x _height pixels, plus the zero row above and column left of the image when
+//_param.zero_pad is set; only the padding is initialized
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::allocate()
+{
+	_pad = _param.zero_pad ? 1 : 0;
+	delete[] _inthist;
+	_inthist = new float[static_cast<size_t>(_width + _pad)*(_height + _pad)*_param.dirnum];
+	if (!_pad)
+		return;
+	for (int idir = 0; idir < _param.dirnum; ++idir)
+	{
+		for (int j = -1; j < _width; ++j) _inthist[index(j, -1, idir)] = 0;
+		for (int i = 0; i < _height; ++i) _inthist[index(-1, i, idir)] = 0;
+	}
+}
+
+//NULL when the atan path has to be used
+OrientationBinning *IntegralHistogramBase::new_binning() const
+{
+	if (_param.vector_binning && OrientationBinning::supported(_param.htype == directed, _param.dirnum))
+		return new OrientationBinning(_param.htype == directed, _param.dirnum);
+	return NULL;
+}
+
+//mod = (h^2 + v^2)^(exp/2)
+void IntegralHistogramBase::magnitude(float *mod, const float *h, const float *v, int n) const
+{
+	for (int i = 0; i < n; ++i) mod[i] = h[i]*h[i] + v[i]*v[i];
 	if( (_param.exp - 1) < eps )
-	  mod.sqrt();
+		for (int i = 0; i < n; ++i) mod[i] = static_cast<float>(std::sqrt(static_cast<double>(mod[i])));
 	else if( (_param.exp - 2) < eps )
-	  while(0);
+		while(0);
 	else
-	  mod.pow( _param.exp/2 );
-	
+		for (int i = 0; i < n; ++i) mod[i] = static_cast<float>(std::pow(static_cast<double>(mod[i]), _param.exp/2.0));
+}
+
+//soft assign n gradients to their two nearest orientation bins, through the atan path when
+//binning is NULL; hist is interleaved, n*dirnum
+void IntegralHistogramBase::bin(const OrientationBinning *binning, float *hist, const float *h, const float *v, const float *mod, int n) const
+{
+	if (binning)
+	{
+		binning->bin(hist, h, v, mod, n);
+		return;
+	}
+
+	const float PI = std::atan2(0, -1);
 	float theta = PI / _param.dirnum;
 	if (_param.htype == directed) theta *= 2;
 
-	for (int i = 0; i < _width*_height; ++i)
+	for (int i = 0; i < n; ++i, hist += _param.dirnum)
 	{
-		float *hist = _inthist + i*_param.dirnum;
+		float angle;
+		if (_param.htype == directed)
+			angle = std::atan2(v[i], h[i]) + PI;
+		else //undirected
+			angle = std::atan(v[i] / (h[i] + eps)) + PI/2;
+
 		for (int idir = 0; idir < _param.dirnum; ++idir) hist[idir] = 0;
 
-		int ileft = static_cast<int>( angle[i] / theta );
+		int ileft = static_cast<int>( angle / theta );
 		int iright = ileft + 1;
 
-		float a = angle[i] - ileft*theta;
-		float b = iright*theta - angle[i];
+		float a = angle - ileft*theta;
+		float b = iright*theta - angle;
 
 		hist[ileft % _param.dirnum] = b*b*mod[i] / (a*a + b*b);
 		hist[iright % _param.dirnum] = a*a*mod[i] / (a*a + b*b);
 	}
+}
+
+//copy the interleaved histograms of row i into a planar _inthist, optionally prefix summing
+//them along the row and adding the row above
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::store_row(int i, const float *hist, bool prefix, bool accumulate)
+{
+	for (int idir = 0; idir < _param.dirnum; ++idir)
+	{
+		float *plane = _inthist + index(0, i, idir);
+		if (prefix)
+		{
+			float sum = 0;
+			for (int j = 0; j < _width; ++j) { sum += hist[j*_param.dirnum + idir]; plane[j] = sum; }
+		}
+		else
+			for (int j = 0; j < _width; ++j) plane[j] = hist[j*_param.dirnum + idir];
+		if (accumulate && i > 0)
+		{
+			const float *above = _inthist + index(0, i - 1, idir);
+			for (int j = 0; j < _width; ++j) plane[j] += above[j];
+		}
+	}
+}
+
+//streaming build of rows [row_begin, row_end): the [-1 0 1] responses are taken from the three
+//source rows around each row, so apart from the output only three rows of scratch are touched.
+//Each row is binned and prefix summed in place and, when accumulate is set, added to the row above
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::build_rows(const Image &img, const OrientationBinning *binning, int row_begin, int row_end, bool accumulate)
+{
+	std::vector<float> buf(3*_width + (Layout::planar ? _width*_param.dirnum : 0));
+	float *h = &buf[0], *v = h + _width, *mod = v + _width;
+	for (int i = row_begin; i < row_end; ++i)
+	{
+		//borders are replicated, as in Image::convolve
+		const float *up = img.ptr(0, std::max(i - 1, 0));
+		const float *row = img.ptr(0, i);
+		const float *down = img.ptr(0, std::min(i + 1, _height - 1));
+		for (int j = 0; j < _width; ++j)
+		{
+			h[j] = row[std::max(j - 1, 0)] - row[std::min(j + 1, _width - 1)];
+			v[j] = up[j] - down[j];
+		}
+		magnitude(mod, h, v, _width);
+
+		if (Layout::planar)
+		{
+			bin(binning, mod + _width, h, v, mod, _width);
+			store_row(i, mod + _width, true, accumulate);
+			continue;
+		}
+
+		float *hist = _inthist + index(0, i, 0);
+		bin(binning, hist, h, v, mod, _width);
+		for (int j = _param.dirnum; j < _width*_param.dirnum; ++j) hist[j] += hist[j - _param.dirnum];
+		if (accumulate && i > 0)
+		{
+			const float *above = _inthist + index(0, i - 1, 0);
+			for (int j = 0; j < _width*_param.dirnum; ++j) hist[j] += above[j];
+		}
+	}
+}
+
+//turn the per pixel histograms in _inthist into the integral histogram, the horizontal pass is
+//split over rows and the vertical pass over columns; every element sees the same additions in
+//the same order for any thread count, so the result does not depend on _param.nthreads
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::integrate()
+{
+	parallel_for(0, _height, _param.nthreads, boost::bind(&BasicIntegralHistogram::integrate_rows, this, _1, _2));
+	parallel_for(0, _width, _param.nthreads, boost::bind(&BasicIntegralHistogram::integrate_columns, this, _1, _2));
+}
 
-	for (int j = 1; j < _width; ++j) //1st row
+//running sum along each row of [row_begin, row_end)
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::integrate_rows(int row_begin, int row_end)
+{
+	for (int i = row_begin; i < row_end; ++i)
 	{
-		float *hist = _inthist + j*_param.dirnum;
-		for (int idir = 0; idir < _param.dirnum; ++idir) 
+		if (Layout::planar)
+			for (int idir = 0; idir < _param.dirnum; ++idir)
+			{
+				float *hist = _inthist + index(0, i, idir);
+				for (int j = 1; j < _width; ++j) hist[j] += hist[j - 1];
+			}
+		else
 		{
-			hist[idir] += hist[idir - 1]; 
+			float *hist = _inthist + index(0, i, 0);
+			for (int j = _param.dirnum; j < _width*_param.dirnum; ++j) hist[j] += hist[j - _param.dirnum];
 		}
 	}
+}
+
+//running sum down each column of [col_begin, col_end)
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::integrate_columns(int col_begin, int col_end)
+{
+	const int planes = Layout::planar ? _param.dirnum : 1;
+	const size_t ps = Layout::pixel_stride(_param.dirnum);
+	const size_t row_stride = index(0, 1, 0) - index(0, 0, 0);
+	for (int idir = 0; idir < planes; ++idir)
+		for (int i = 1; i < _height; ++i)
+		{
+			float *hist = _inthist + index(col_begin, i, idir);
+			const float *above = hist - row_stride;
+			for (size_t j = 0; j < (col_end - col_begin)*ps; ++j) hist[j] += above[j];
+		}
+}
 
-	float *current_row_inthist = new float[_param.dirnum];
-	for (int i = 1; i < _height; ++i)
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::resample(const BasicIntegralHistogram &src, int width, int height, float gain)
+{
+	if (width <= 0 || height <= 0)
+		throw std::runtime_error( boost::str(boost::format("Invalid resample size %1%x%2%") % width % height) );
+	_width = width;
+	_height = height;
+	_param.htype = src._param.htype;
+	_param.dirnum = src._param.dirnum;
+	allocate();
+	parallel_for(0, _height, _param.nthreads, boost::bind(&BasicIntegralHistogram::resample_rows, this, &src, gain, _1, _2));
+}
+
+//pixel (u, v) of the result holds the integral of src over [0, (u + 1)*rx) x [0, (v + 1)*ry) in
+//source pixels; the integral of a piecewise constant image is bilinear inside a pixel, so the
+//corners are interpolated exactly from the four surrounding integral values
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::resample_rows(const BasicIntegralHistogram *src, float gain, int row_begin, int row_end)
+{
+	const float rx = static_cast<float>(src->_width) / _width;
+	const float ry = static_cast<float>(src->_height) / _height;
+	const float scale = gain / (rx*ry);
+	std::vector<int> xs(_width);
+	std::vector<float> fxs(_width);
+	for (int u = 0; u < _width; ++u)
 	{
-	  for (int idir = 0; idir < _param.dirnum; ++idir) current_row_inthist[idir] = 0;
-	  for (int j = 0; j < _width; ++j)
-	  {
-		  float *hist = _inthist + (i*_width + j)*_param.dirnum;
-		  for (int idir = 0; idir < _param.dirnum; ++idir) 
-		  {
-			  current_row_inthist[idir] += hist[idir];
-			  hist[idir] = _inthist[((i - 1)*_width + j)*_param.dirnum + idir] + current_row_inthist[idir]; 
-		  }
-	  }
+		float x = std::min((u + 1)*rx, static_cast<float>(src->_width));
+		xs[u] = std::min(static_cast<int>(x), src->_width - 1);
+		fxs[u] = x - xs[u];
+	}
+
+	const ptrdiff_t dx = src->offset(1, 0), dy = src->offset(0, 1);
+	const size_t src_bs = src->bin_stride(), bs = bin_stride();
+	for (int v = row_begin; v < row_end; ++v)
+	{
+		float y = std::min((v + 1)*ry, static_cast<float>(src->_height));
+		int y0 = std::min(static_cast<int>(y), src->_height - 1);
+		float fy = y - y0;
+		for (int u = 0; u < _width; ++u)
+		{
+			int x0 = xs[u];
+			float fx = fxs[u];
+			float w00 = scale*(1 - fx)*(1 - fy), w10 = scale*fx*(1 - fy), w01 = scale*(1 - fx)*fy, w11 = scale*fx*fy;
+			float *out = _inthist + index(u, v, 0);
+			if (src->_pad || (x0 > 0 && y0 > 0))
+			{
+				const float *s00 = src->_inthist + src->index(x0 - 1, y0 - 1, 0);
+				for (int idir = 0; idir < _param.dirnum; ++idir, s00 += src_bs)
+					out[idir*bs] = w00*s00[0] + w10*s00[dx] + w01*s00[dy] + w11*s00[dx + dy];
+			}
+			else
+				for (int idir = 0; idir < _param.dirnum; ++idir)
+					out[idir*bs] = w00*src->integral(x0, y0, idir) + w10*src->integral(x0 + 1, y0, idir)
+						+ w01*src->integral(x0, y0 + 1, idir) + w11*src->integral(x0 + 1, y0 + 1, idir);
+		}
 	}
 }
 
-//load saved integral histogram from file system
-IntegralHistogram &IntegralHistogram::load( const char *fn )
+//histograms of the count boxes [x0 + k, y0, x1 + k, y1], k = 0..count-1, written bin by bin:
+//hist[bin*count + k]. Unnormalized; with PlanarLayout the loop over k is contiguous
+template<typename Layout>
+void BasicIntegralHistogram<Layout>::get_hist_row(float *hist, int x0, int y0, int x1, int y1, int count) const
+{
+	if ( x0 < 0 || y0 < 0 || x0 > x1 || y0 > y1 || x1 + count > _width || y1 >= _height)
+		throw std::runtime_error( boost::str(boost::format("Invalid index [%1% %2% %3% %4%] x %5%") % x0 % y0 % x1 % y1 % count) );
+
+	const size_t ps = Layout::pixel_stride(_param.dirnum);
+	for (int idir = 0; idir < _param.dirnum; ++idir, hist += count)
+	{
+		const float *r1 = _inthist + index(0, y1, idir);
+		const float *r0 = y0 > 0 || _pad ? _inthist + index(0, y0 - 1, idir) : NULL;
+		int k = 0;
+		if (x0 == 0 && !_pad)
+		{
+			hist[0] = r1[x1*ps] - (r0 ? r0[x1*ps] : 0);
+			k = 1;
+		}
+		if (r0)
+			for (; k < count; ++k)
+				hist[k] = r1[(x1 + k)*ps] - r1[(x0 + k - 1)*ps] - r0[(x1 + k)*ps] + r0[(x0 + k - 1)*ps];
+		else
+			for (; k < count; ++k)
+				hist[k] = r1[(x1 + k)*ps] - r1[(x0 + k - 1)*ps];
+	}
+}
+
+//load saved integral histogram from file system, the file is always interleaved
+template<typename Layout>
+BasicIntegralHistogram<Layout> &BasicIntegralHistogram<Layout>::load( const char *fn )
 {
 	std::fstream fin;
 	fin.open( fn, std::ios::in|std::ios::binary);
@@ -141,8 +384,18 @@ IntegralHistogram &IntegralHistogram::load( const char *fn )
 		fin.read(reinterpret_cast<char *>(&_width), sizeof(_width))		\
 			.read(reinterpret_cast<char *>(&_height), sizeof(_height))	\
 			.read(reinterpret_cast<char *>(&_param.htype), sizeof(_param.htype))		\
-			.read(reinterpret_cast<char *>(&_param.dirnum), sizeof(_param.dirnum))	\
-			.read(reinterpret_cast<char *>(_inthist), _width*_height*_param.dirnum*sizeof(_inthist[0]));
+			.read(reinterpret_cast<char *>(&_param.dirnum), sizeof(_param.dirnum));
+		allocate();
+		std::vector<float> row(_width*_param.dirnum);
+		for (int i = 0; i < _height; ++i)
+		{
+			float *dst = Layout::planar ? &row[0] : _inthist + index(0, i, 0);
+			fin.read(reinterpret_cast<char *>(dst), row.size()*sizeof(row[0]));
+			if (Layout::planar)
+				store_row(i, &row[0], false, false);
+		}
+		if (!fin.good())
+			throw std::runtime_error( boost::str(boost::format("Failed to read %1%") % fn ) );
 	}
 	else
 		throw std::runtime_error( boost::str(boost::format("Failed to open %1%") % fn ) );
@@ -151,8 +404,9 @@ IntegralHistogram &IntegralHistogram::load( const char *fn )
 	return *this;
 }
 
-//save integral histogram to file system
-IntegralHistogram &IntegralHistogram::save( const char *fn )
+//save integral histogram to file system, the file is always interleaved
+template<typename Layout>
+BasicIntegralHistogram<Layout> &BasicIntegralHistogram<Layout>::save( const char *fn )
 {
 	std::fstream fout;
 	fout.open( fn, std::ios::out|std::ios::binary);
@@ -161,8 +415,19 @@ IntegralHistogram &IntegralHistogram::save( const char *fn )
 		fout.write(reinterpret_cast<char *>(&_width), sizeof(_width))		\
 			.write(reinterpret_cast<char *>(&_height), sizeof(_height))	\
 			.write(reinterpret_cast<char *>(&_param.htype), sizeof(_param.htype))		\
-			.write(reinterpret_cast<char *>(&_param.dirnum), sizeof(_param.dirnum))	\
-			.write(reinterpret_cast<char *>(_inthist), _width*_height*_param.dirnum*sizeof(_inthist[0]));
+			.write(reinterpret_cast<char *>(&_param.dirnum), sizeof(_param.dirnum));
+		std::vector<float> row(_width*_param.dirnum);
+		for (int i = 0; i < _height; ++i)
+		{
+			const float *src = _inthist + index(0, i, 0);
+			if (Layout::planar)
+			{
+				for (int j = 0; j < _width; ++j)
+					for (int idir = 0; idir < _param.dirnum; ++idir) row[j*_param.dirnum + idir] = _inthist[index(j, i, idir)];
+				src = &row[0];
+			}
+			fout.write(reinterpret_cast<const char *>(src), row.size()*sizeof(row[0]));
+		}
 	}
 	else
 		throw std::runtime_error( boost::str(boost::format("Failed to open %1%") % fn ) );
@@ -171,3 +436,5 @@ IntegralHistogram &IntegralHistogram::save( const char *fn )
 	return *this;
 }
 
+template class BasicIntegralHistogram<InterleavedLayout>;
+template class BasicIntegralHistogram<PlanarLayout>;
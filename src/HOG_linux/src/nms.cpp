@@ -0,0 +1,222 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Greedy and soft non-maximum suppression on a uniform grid of boxes.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "nms.h"
+
+#include <boost/format.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <queue>
+#include <cmath>
+
+namespace
+{
+	inline double area(const int32_t *box)
+	{
+		return static_cast<double>(box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+	}
+
+	//decreasing score, ties by index so the result does not depend on the sort
+	struct ByScore
+	{
+		const float *scores;
+		ByScore(const float *s):scores(s){}
+		bool operator()(int a, int b) const { return scores[a] > scores[b] || (scores[a] == scores[b] && a < b); }
+	};
+}
+
+float NonMaxSuppression::iou(const int32_t *a, const int32_t *b)
+{
+	int32_t w = std::min(a[2], b[2]) - std::max(a[0], b[0]) + 1;
+	int32_t h = std::min(a[3], b[3]) - std::max(a[1], b[1]) + 1;
+	if (w <= 0 || h <= 0)
+		return 0;
+	double inter = static_cast<double>(w) * h;
+	return static_cast<float>(inter / (area(a) + area(b) - inter));
+}
+
+void NonMaxSuppression::build_grid(const int32_t *boxes, int count)
+{
+	int32_t x1 = boxes[2], y1 = boxes[3];
+	double side = 0;
+	_x0 = boxes[0];
+	_y0 = boxes[1];
+	for (int k = 0; k < count; ++k)
+	{
+		const int32_t *box = boxes + 4*k;
+		if (box[2] < box[0] || box[3] < box[1])
+			throw std::runtime_error( boost::str(boost::format("Invalid box [%1% %2% %3% %4%]") % box[0] % box[1] % box[2] % box[3]) );
+		_x0 = std::min(_x0, box[0]);
+		_y0 = std::min(_y0, box[1]);
+		x1 = std::max(x1, box[2]);
+		y1 = std::max(y1, box[3]);
+		side += (box[2] - box[0] + box[3] - box[1] + 2) / 2.0;
+	}
+	//a box of the mean size touches about four cells
+	_cell = _param.cell > 0 ? _param.cell : std::max(static_cast<int>(side / count), 1);
+	_cols = (x1 - _x0) / _cell + 1;
+	_rows = (y1 - _y0) / _cell + 1;
+
+	//the buckets keep their capacity from call to call
+	if (_buckets.size() < static_cast<size_t>(_cols)*_rows)
+		_buckets.resize(static_cast<size_t>(_cols)*_rows);
+	for (size_t b = 0; b < static_cast<size_t>(_cols)*_rows; ++b)
+		_buckets[b].clear();
+	_stamp.assign(count, -1);
+}
+
+void NonMaxSuppression::cells(int &c0, int &r0, int &c1, int &r1, const int32_t *box) const
+{
+	c0 = (box[0] - _x0) / _cell;
+	r0 = (box[1] - _y0) / _cell;
+	c1 = (box[2] - _x0) / _cell;
+	r1 = (box[3] - _y0) / _cell;
+}
+
+void NonMaxSuppression::insert(const int32_t *boxes, int k)
+{
+	int c0, r0, c1, r1;
+	cells(c0, r0, c1, r1, boxes + 4*k);
+	for (int c = c0; c <= c1; ++c)
+		for (int r = r0; r <= r1; ++r)
+			_buckets[static_cast<size_t>(c)*_rows + r].push_back(k);
+}
+
+//in decreasing score order a box is kept unless a kept box overlaps it by more than overlap; only the
+//kept boxes are in the grid
+void NonMaxSuppression::suppress_greedy(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, int count)
+{
+	_order.resize(count);
+	for (int k = 0; k < count; ++k) _order[k] = k;
+	std::sort(_order.begin(), _order.end(), ByScore(scores));
+
+	for (int n = 0; n < count; ++n)
+	{
+		const int k = _order[n];
+		const int32_t *box = boxes + 4*k;
+		int c0, r0, c1, r1;
+		cells(c0, r0, c1, r1, box);
+		bool suppressed = false;
+		for (int c = c0; c <= c1 && !suppressed; ++c)
+			for (int r = r0; r <= r1 && !suppressed; ++r)
+			{
+				const std::vector<int> &bucket = _buckets[static_cast<size_t>(c)*_rows + r];
+				for (unsigned int b = 0; b < bucket.size(); ++b)
+				{
+					if (_stamp[bucket[b]] == k)
+						continue;
+					_stamp[bucket[b]] = k;
+					if (iou(box, boxes + 4*bucket[b]) > _param.overlap)
+					{
+						suppressed = true;
+						break;
+					}
+				}
+			}
+		if (suppressed)
+			continue;
+		keep.push_back(k);
+		kept_scores.push_back(scores[k]);
+		insert(boxes, k);
+	}
+}
+
+//the box of highest current score is kept and the scores of the boxes it overlaps decay. Scores only
+//decrease, so a heap entry is an upper bound of its box: a stale top is pushed again with the current
+//score instead of updating the heap on every decay. Finished boxes leave the buckets as they are met
+void NonMaxSuppression::suppress_soft(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, int count)
+{
+	std::vector<float> current(scores, scores + count);
+	std::vector<bool> done(count, false);
+	std::priority_queue<std::pair<float, int> > heap;
+	for (int k = 0; k < count; ++k)
+	{
+		insert(boxes, k);
+		if (current[k] >= _param.min_score)
+			heap.push(std::make_pair(current[k], -k));
+		else
+			done[k] = true;
+	}
+
+	while (!heap.empty())
+	{
+		std::pair<float, int> top = heap.top();
+		heap.pop();
+		const int k = -top.second;
+		if (done[k])
+			continue;
+		if (top.first != current[k])
+		{
+			if (current[k] >= _param.min_score)
+				heap.push(std::make_pair(current[k], -k));
+			else
+				done[k] = true;
+			continue;
+		}
+		done[k] = true;
+		keep.push_back(k);
+		kept_scores.push_back(current[k]);
+
+		const int32_t *box = boxes + 4*k;
+		int c0, r0, c1, r1;
+		cells(c0, r0, c1, r1, box);
+		for (int c = c0; c <= c1; ++c)
+			for (int r = r0; r <= r1; ++r)
+			{
+				std::vector<int> &bucket = _buckets[static_cast<size_t>(c)*_rows + r];
+				for (unsigned int b = 0; b < bucket.size(); )
+				{
+					const int j = bucket[b];
+					if (done[j])
+					{
+						bucket[b] = bucket.back();
+						bucket.pop_back();
+						continue;
+					}
+					++b;
+					if (_stamp[j] == k)
+						continue;
+					_stamp[j] = k;
+					float o = iou(box, boxes + 4*j);
+					if (o <= 0)
+						continue;
+					if (_param.type == gaussian)
+						current[j] *= std::exp(-o*o / _param.sigma);
+					else if (o > _param.overlap)
+						current[j] *= 1 - o;
+				}
+			}
+	}
+}
+
+int NonMaxSuppression::suppress(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, int count)
+{
+	int begin[2] = {0, count};
+	return suppress(keep, kept_scores, boxes, scores, begin, 1);
+}
+
+int NonMaxSuppression::suppress(std::vector<int> &keep, std::vector<float> &kept_scores, const int32_t *boxes, const float *scores, const int *begin, int images)
+{
+	keep.clear();
+	kept_scores.clear();
+	for (int i = 0; i < images; ++i)
+	{
+		const int count = begin[i + 1] - begin[i];
+		if (count < 0)
+			throw std::runtime_error( boost::str(boost::format("Image %1% has %2% boxes") % i % count) );
+		if (count == 0)
+			continue;
+
+		const int first = static_cast<int>(keep.size());
+		const int32_t *image_boxes = boxes + 4*static_cast<size_t>(begin[i]);
+		build_grid(image_boxes, count);
+		if (_param.type == greedy)
+			suppress_greedy(keep, kept_scores, image_boxes, scores + begin[i], count);
+		else
+			suppress_soft(keep, kept_scores, image_boxes, scores + begin[i], count);
+		for (unsigned int k = first; k < keep.size(); ++k)
+			keep[k] += begin[i];
+	}
+	return static_cast<int>(keep.size());
+}
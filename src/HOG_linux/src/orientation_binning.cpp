@@ -0,0 +1,233 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: Soft two-bin orientation binning of image gradients without transcendental calls.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "orientation_binning.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ORIENTATION_BINNING_AVX2
+#include "hist_simd.h"
+#endif
+
+namespace
+{
+	const float EPS = 1e-10f;   //same as IntegralHistogram::eps
+	const float TINY = 1e-30f;
+
+	//arctangent on [0, 1], Abramowitz & Stegun 4.4.49
+	const float ATAN_C[8] = { -0.3333314528f, 0.1999355085f, -0.1420889944f, 0.1065626393f,
+		-0.0752896400f, 0.0429096138f, -0.0161657367f, 0.0028662257f };
+
+	inline float atan01(float t)
+	{
+		float t2 = t*t;
+		float p = ATAN_C[7];
+		for (int i = 6; i >= 0; --i) p = p*t2 + ATAN_C[i];
+		return t + t*t2*p;
+	}
+
+	//N floats in one register through GCC vector extensions: the instructions generated for them
+	//follow the target of the function they are inlined into, so that the kernel below compiles
+	//to AVX2 inside bin_avx2 and to SSE2 inside bin_sse2
+	template<int N>
+	struct Lanes
+	{
+		typedef float vfloat __attribute__((vector_size(4*N)));
+		typedef int vint __attribute__((vector_size(4*N)));
+		typedef float vfloat_u __attribute__((vector_size(4*N), aligned(4)));   //unaligned loads and stores
+		typedef int vint_u __attribute__((vector_size(4*N), aligned(4)));
+		static const int VLEN = N;
+	};
+	typedef Lanes<8> Avx2;
+	typedef Lanes<4> Sse2;
+}
+
+OrientationBinning::OrientationBinning(bool directed, int dirnum): _directed(directed), _dirnum(dirnum)
+{
+	const double PI = std::atan2(0.0, -1.0);
+	double theta = directed ? 2*PI / dirnum : PI / dirnum;
+	_theta = static_cast<float>(theta);
+
+	//undirected gradients live in the upper half plane, the extra direction at pi wraps to bin 0
+	_ndirs = directed ? dirnum : dirnum + 1;
+	_cos.resize(_ndirs);
+	_sin.resize(_ndirs);
+	_cos_prev.resize(_ndirs);
+	_sin_prev.resize(_ndirs);
+	for (int k = 0; k < _ndirs; ++k)
+	{
+		_cos[k] = static_cast<float>(std::cos(k*theta));
+		_sin[k] = static_cast<float>(std::sin(k*theta));
+		_cos_prev[k] = static_cast<float>(std::cos((k - 1)*theta));
+		_sin_prev[k] = static_cast<float>(std::sin((k - 1)*theta));
+	}
+	for (int k = -1; k < _ndirs; ++k)
+	{
+		_left.push_back((k + dirnum) % dirnum);
+		_right.push_back((k + 1) % dirnum);
+	}
+}
+
+bool OrientationBinning::supported(bool directed, int dirnum)
+{
+	return directed ? dirnum >= 8 : dirnum >= 4;
+}
+
+//the gradient u is rotated such that its polar angle equals the angle used by the atan path:
+//directed atan2(v, h) + pi, undirected atan(v/h) + pi/2
+void OrientationBinning::bin_scalar(float *hist, const float *h, const float *v, const float *mod, int n) const
+{
+	for (int i = 0; i < n; ++i, hist += _dirnum)
+	{
+		float ux, uy;
+		if (_directed)
+		{
+			ux = -h[i];
+			uy = -v[i];
+		}
+		else
+		{
+			float hh = h[i] + EPS;
+			ux = hh < 0 ? v[i] : -v[i];
+			uy = std::fabs(hh);
+		}
+
+		int m = 0;
+		float best = ux;
+		for (int k = 1; k < _ndirs; ++k)
+		{
+			float d = _cos[k]*ux + _sin[k]*uy;
+			if (d > best) { best = d; m = k; }
+		}
+
+		int l = m;
+		float cl = _cos[m], sl = _sin[m];
+		if (cl*uy - sl*ux < 0)
+		{
+			l = m - 1;
+			cl = _cos_prev[m];
+			sl = _sin_prev[m];
+		}
+
+		float t = (cl*uy - sl*ux) / std::max(cl*ux + sl*uy, TINY);
+		float a = std::min(atan01(std::min(std::max(t, 0.0f), 1.0f)), _theta);
+		float b = _theta - a;
+
+		for (int idir = 0; idir < _dirnum; ++idir) hist[idir] = 0;
+		hist[_left[l + 1]] = b*b*mod[i] / (a*a + b*b);
+		hist[_right[l + 1]] = a*a*mod[i] / (a*a + b*b);
+	}
+}
+
+void OrientationBinning::scatter(float *hist, const int *bin_l, const float *w_l, const float *w_r, int n) const
+{
+	for (int j = 0; j < n; ++j, hist += _dirnum)
+	{
+		for (int idir = 0; idir < _dirnum; ++idir) hist[idir] = 0;
+		hist[_left[bin_l[j] + 1]] = w_l[j];
+		hist[_right[bin_l[j] + 1]] = w_r[j];
+	}
+}
+
+//bin_scalar on VLEN pixels at a time, the maximum search runs over all directions; returns the
+//number of pixels binned, a multiple of VLEN
+template<typename V>
+inline __attribute__((always_inline))
+int OrientationBinning::bin_lanes(float *hist, const float *h, const float *v, const float *mod, int n) const
+{
+	typedef typename V::vfloat vfloat;
+	typedef typename V::vint vint;
+	typedef typename V::vfloat_u vfloat_u;
+	typedef typename V::vint_u vint_u;
+	const vfloat zero = vfloat(), one = zero + 1.0f, tiny = zero + TINY, theta = zero + _theta;
+	const vint sign = (vint)(-zero);
+	int bin_l[V::VLEN];
+	float w_l[V::VLEN], w_r[V::VLEN];
+	int i = 0;
+	for (; i + V::VLEN <= n; i += V::VLEN)
+	{
+		vfloat ux, uy;
+		if (_directed)
+		{
+			ux = -*reinterpret_cast<const vfloat_u *>(h + i);
+			uy = -*reinterpret_cast<const vfloat_u *>(v + i);
+		}
+		else
+		{
+			vfloat hh = *reinterpret_cast<const vfloat_u *>(h + i) + EPS;
+			vint hsign = (vint)hh & sign;
+			ux = (vfloat)((vint)(-*reinterpret_cast<const vfloat_u *>(v + i)) ^ hsign);
+			uy = (vfloat)((vint)hh ^ hsign);
+		}
+
+		vfloat best = ux, m = zero, cm = one, sm = zero, cp = zero + _cos_prev[0], sp = zero + _sin_prev[0];
+		for (int k = 1; k < _ndirs; ++k)
+		{
+			vfloat d = _cos[k]*ux + _sin[k]*uy;
+			vint gt = d > best;
+			best = gt ? d : best;
+			m = gt ? zero + static_cast<float>(k) : m;
+			cm = gt ? zero + _cos[k] : cm;
+			sm = gt ? zero + _sin[k] : sm;
+			cp = gt ? zero + _cos_prev[k] : cp;
+			sp = gt ? zero + _sin_prev[k] : sp;
+		}
+
+		vint prev = cm*uy - sm*ux < zero;
+		vfloat l = prev ? m - 1.0f : m;
+		vfloat cl = prev ? cp : cm;
+		vfloat sl = prev ? sp : sm;
+
+		vfloat den = cl*ux + sl*uy;
+		vfloat t = (cl*uy - sl*ux) / (den > tiny ? den : tiny);
+		t = t > zero ? t : zero;
+		t = t < one ? t : one;
+		vfloat t2 = t*t;
+		vfloat p = zero + ATAN_C[7];
+		for (int c = 6; c >= 0; --c) p = p*t2 + ATAN_C[c];
+		vfloat a = t + t*t2*p;
+		a = a < theta ? a : theta;
+		vfloat b = theta - a;
+		vfloat norm = *reinterpret_cast<const vfloat_u *>(mod + i) / (a*a + b*b);
+
+		*reinterpret_cast<vint_u *>(bin_l) = __builtin_convertvector(l, vint);
+		*reinterpret_cast<vfloat_u *>(w_l) = b*b*norm;
+		*reinterpret_cast<vfloat_u *>(w_r) = a*a*norm;
+		scatter(hist + i*_dirnum, bin_l, w_l, w_r, V::VLEN);
+	}
+	return i;
+}
+
+#if defined(ORIENTATION_BINNING_AVX2)
+__attribute__((target("avx2")))
+int OrientationBinning::bin_avx2(float *hist, const float *h, const float *v, const float *mod, int n) const
+{
+	return bin_lanes<Avx2>(hist, h, v, mod, n);
+}
+#endif
+
+#if defined(__SSE2__)
+int OrientationBinning::bin_sse2(float *hist, const float *h, const float *v, const float *mod, int n) const
+{
+	return bin_lanes<Sse2>(hist, h, v, mod, n);
+}
+#endif
+
+void OrientationBinning::bin(float *hist, const float *h, const float *v, const float *mod, int n) const
+{
+	int i = 0;
+	bool avx2 = false;
+#if defined(ORIENTATION_BINNING_AVX2)
+	avx2 = hist8_avx2_supported();
+	if (avx2)
+		i = bin_avx2(hist, h, v, mod, n);
+#endif
+#if defined(__SSE2__)
+	if (!avx2)
+		i = bin_sse2(hist, h, v, mod, n);
+#endif
+	bin_scalar(hist + i*_dirnum, h + i, v + i, mod + i, n - i);
+}
@@ -0,0 +1,251 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Description: 8-bit and half precision descriptor storage and quantized dot products.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "quantized.h"
+#include "hist_simd.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QUANTIZED_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	inline uint8_t to_u8(float v)
+	{
+		float q = v*255.0f + 0.5f;
+		return static_cast<uint8_t>(std::min(std::max(q, 0.0f), 255.0f));
+	}
+
+	inline uint16_t to_half(float f)
+	{
+		uint32_t x;
+		std::memcpy(&x, &f, sizeof(x));
+		uint32_t sign = (x >> 16) & 0x8000;
+		uint32_t fexp = (x >> 23) & 0xff;
+		uint32_t mant = x & 0x7fffff;
+		if (fexp == 0xff)   //inf, nan
+			return static_cast<uint16_t>(sign | 0x7c00 | (mant ? 0x200 : 0));
+
+		int exp = static_cast<int>(fexp) - 127 + 15;
+		if (exp >= 31)
+			return static_cast<uint16_t>(sign | 0x7c00);
+		uint32_t half, rem, mid;
+		if (exp <= 0)   //subnormal half
+		{
+			if (exp < -10)
+				return static_cast<uint16_t>(sign);
+			mant |= 0x800000;
+			int shift = 14 - exp;
+			half = mant >> shift;
+			rem = mant & ((1u << shift) - 1);
+			mid = 1u << (shift - 1);
+		}
+		else
+		{
+			half = (static_cast<uint32_t>(exp) << 10) | (mant >> 13);
+			rem = mant & 0x1fff;
+			mid = 0x1000;
+		}
+		//a carry out of the mantissa correctly bumps the exponent
+		if (rem > mid || (rem == mid && (half & 1)))
+			++half;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	inline float from_half(uint16_t h)
+	{
+		uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+		uint32_t exp = (h >> 10) & 0x1f;
+		uint32_t mant = h & 0x3ff;
+		uint32_t x;
+		if (exp == 0)
+		{
+			float v = std::ldexp(static_cast<float>(mant), -24);
+			return sign ? -v : v;
+		}
+		if (exp == 31)
+			x = sign | 0x7f800000 | (mant << 13);
+		else
+			x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+		float f;
+		std::memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+
+#if defined(QUANTIZED_AVX2)
+	bool simd()
+	{
+		static const bool supported = hist8_avx2_supported() && __builtin_cpu_supports("f16c");
+		return supported;
+	}
+
+	__attribute__((target("avx2"))) inline float hsum(__m256 v)
+	{
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+
+	__attribute__((target("avx2"))) int quantize_u8_avx2(uint8_t *q, const float *v, int n)
+	{
+		const __m256 scale = _mm256_set1_ps(255.0f), half = _mm256_set1_ps(0.5f);
+		const __m256 lo = _mm256_setzero_ps(), hi = _mm256_set1_ps(255.0f);
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(v + i), scale), half);
+			__m256i k = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(x, lo), hi));
+			__m128i k16 = _mm_packus_epi32(_mm256_castsi256_si128(k), _mm256_extracti128_si256(k, 1));
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(q + i), _mm_packus_epi16(k16, k16));
+		}
+		return i;
+	}
+
+	__attribute__((target("avx2,f16c"))) int float_to_half_avx2(uint16_t *h, const float *v, int n)
+	{
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(h + i), _mm256_cvtps_ph(_mm256_loadu_ps(v + i), _MM_FROUND_TO_NEAREST_INT));
+		return i;
+	}
+
+	__attribute__((target("avx2,f16c"))) int half_to_float_avx2(float *v, const uint16_t *h, int n)
+	{
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(v + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i))));
+		return i;
+	}
+
+	__attribute__((target("avx2"))) float dot_u8_avx2(const float *w, const uint8_t *q, int n, int &done)
+	{
+		__m256 acc = _mm256_setzero_ps();
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(q + i))));
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(w + i), x));
+		}
+		done = i;
+		return hsum(acc);
+	}
+
+	__attribute__((target("avx2"))) uint32_t dot_u8u8_avx2(const uint8_t *a, const uint8_t *b, int n, int &done)
+	{
+		__m256i acc = _mm256_setzero_si256();
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			__m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+			__m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+		}
+		done = i;
+		__m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(s));
+	}
+
+	__attribute__((target("avx2,f16c"))) float dot_f16_avx2(const float *w, const uint16_t *h, int n, int &done)
+	{
+		__m256 acc = _mm256_setzero_ps();
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i)));
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(w + i), x));
+		}
+		done = i;
+		return hsum(acc);
+	}
+#endif
+}
+
+void quantize_u8(uint8_t *q, const float *v, int n)
+{
+	int i = 0;
+#if defined(QUANTIZED_AVX2)
+	if (simd())
+		i = quantize_u8_avx2(q, v, n);
+#endif
+	for (; i < n; ++i) q[i] = to_u8(v[i]);
+}
+
+void dequantize_u8(float *v, const uint8_t *q, int n)
+{
+	for (int i = 0; i < n; ++i) v[i] = q[i] / 255.0f;
+}
+
+void float_to_half(uint16_t *h, const float *v, int n)
+{
+	int i = 0;
+#if defined(QUANTIZED_AVX2)
+	if (simd())
+		i = float_to_half_avx2(h, v, n);
+#endif
+	for (; i < n; ++i) h[i] = to_half(v[i]);
+}
+
+void half_to_float(float *v, const uint16_t *h, int n)
+{
+	int i = 0;
+#if defined(QUANTIZED_AVX2)
+	if (simd())
+		i = half_to_float_avx2(v, h, n);
+#endif
+	for (; i < n; ++i) v[i] = from_half(h[i]);
+}
+
+float dot_u8(const float *w, const uint8_t *q, int n)
+{
+	float sum = 0;
+	int i = 0;
+#if defined(QUANTIZED_AVX2)
+	if (simd())
+		sum = dot_u8_avx2(w, q, n, i);
+#endif
+	for (; i < n; ++i) sum += w[i]*q[i];
+	return sum / 255.0f;
+}
+
+uint32_t dot_u8u8(const uint8_t *a, const uint8_t *b, int n)
+{
+	uint32_t sum = 0;
+	int i = 0;
+#if defined(QUANTIZED_AVX2)
+	if (simd())
+		sum = dot_u8u8_avx2(a, b, n, i);
+#endif
+	for (; i < n; ++i) sum += static_cast<uint32_t>(a[i])*b[i];
+	return sum;
+}
+
+float dot_f16(const float *w, const uint16_t *h, int n)
+{
+	float sum = 0;
+	int i = 0;
+#if defined(QUANTIZED_AVX2)
+	if (simd())
+		sum = dot_f16_avx2(w, h, n, i);
+#endif
+	for (; i < n; ++i) sum += w[i]*from_half(h[i]);
+	return sum;
+}
+
+void score_u8(float *scores, const float *w, float bias, const uint8_t *dscr, size_t stride, int count, int n)
+{
+	for (int k = 0; k < count; ++k) scores[k] = dot_u8(w, dscr + k*stride, n) + bias;
+}
+
+void score_f16(float *scores, const float *w, float bias, const uint16_t *dscr, size_t stride, int count, int n)
+{
+	for (int k = 0; k < count; ++k) scores[k] = dot_f16(w, dscr + k*stride, n) + bias;
+}
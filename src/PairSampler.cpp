@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include "PairSampler.h"
+
+using namespace std;
+
+PairSampler::PairSampler(Param& param)
+  :_param(param),_rng(param.seed),_seen(0)
+{
+  if (param.strata < 1 || param.reservoir < 2 || param.pairs < 1 || param.batch < 1)
+    throw runtime_error( boost::str(boost::format("Invalid pair sampler %1% strata, reservoir %2%, %3% pairs, batch %4%")
+      % param.strata % param.reservoir % param.pairs % param.batch) );
+  _reservoirs.resize(param.strata);
+  _index.resize(param.strata);
+  for (int s = 0; s < param.strata; ++s)
+  {
+    _reservoirs[s].reserve(param.reservoir);
+    _index[s].reserve(param.reservoir);
+  }
+  _counts.reserve(param.strata);
+  _windows.reserve((size_t)param.strata * param.reservoir);
+  _pairs.reserve(param.pairs);
+  _shares.reserve((size_t)param.strata * (param.strata + 1) / 2);
+  _gains.reserve(param.reservoir);
+  begin();
+}
+
+void PairSampler::begin()
+{
+  for (int s = 0; s < _param.strata; ++s)
+    _reservoirs[s].clear();
+  _counts.assign(_param.strata, 0);
+  _seen = 0;
+  _windows.clear();
+  _pairs.clear();
+}
+
+int PairSampler::stratum(uint32_t gain) const
+{
+  int s = 0;
+  while (gain > 0 && s < _param.strata - 1)
+  {
+    ++s;
+    gain >>= 1;
+  }
+  return s;
+}
+
+void PairSampler::add(int window, uint32_t gain)
+{
+  int s = stratum(gain);
+  vector<Member>& reservoir = _reservoirs[s];
+  ++_counts[s];
+  ++_seen;
+  if ((int)reservoir.size() < _param.reservoir)
+  {
+    reservoir.push_back(Member(window, gain));
+    return;
+  }
+  boost::random::uniform_int_distribution<long> pick(0, _counts[s] - 1);
+  long r = pick(_rng);
+  if (r < _param.reservoir)
+    reservoir[r] = Member(window, gain);
+}
+
+double PairSampler::meanDifference(int a, int b)
+{
+  const vector<Member>& ra = _reservoirs[a];
+  const vector<Member>& rb = _reservoirs[b];
+  if (a != b)
+  {
+    //every gain of a higher stratum is larger
+    double sa = 0, sb = 0;
+    for (size_t k = 0; k < ra.size(); ++k)
+      sa += ra[k].gain;
+    for (size_t k = 0; k < rb.size(); ++k)
+      sb += rb[k].gain;
+    return sa / ra.size() - sb / rb.size();
+  }
+  if (ra.size() < 2)
+    return 0;
+
+  //sum over i < j of g_(j) - g_(i) = sum of g_(k) (2k - n + 1) on the sorted gains
+  vector<uint32_t>& gains = _gains;
+  gains.resize(ra.size());
+  for (size_t k = 0; k < ra.size(); ++k)
+    gains[k] = ra[k].gain;
+  sort(gains.begin(), gains.end());
+  double n = (double)gains.size(), sum = 0;
+  for (size_t k = 0; k < gains.size(); ++k)
+    sum += gains[k] * (2.0*k - n + 1);
+  return sum / (n*(n - 1)/2);
+}
+
+int PairSampler::sample()
+{
+  _windows.clear();
+  _pairs.clear();
+
+  vector<Share>& shares = _shares;
+  shares.clear();
+  double total = 0;
+  for (int a = 0; a < _param.strata; ++a)
+    for (int b = 0; b <= a; ++b)
+    {
+      if (_reservoirs[a].empty() || _reservoirs[b].empty())
+        continue;
+      double population = a == b ? _counts[a]*(_counts[a] - 1.0)/2 : (double)_counts[a]*_counts[b];
+      double weight = population * meanDifference(a, b);
+      if (weight <= 0)
+        continue;
+      shares.push_back(Share(a, b, population, weight));
+      total += weight;
+    }
+  if (shares.empty())
+    return 0;
+
+  //largest remainder split of the budget
+  int assigned = 0;
+  for (size_t s = 0; s < shares.size(); ++s)
+  {
+    double exact = _param.pairs * shares[s].weight / total;
+    shares[s].pairs = (int)exact;
+    shares[s].remainder = exact - shares[s].pairs;
+    assigned += shares[s].pairs;
+  }
+  sort(shares.begin(), shares.end(), byRemainder);
+  for (size_t s = 0; assigned < _param.pairs && s < shares.size(); ++s, ++assigned)
+    ++shares[s].pairs;
+
+  //compact index of the reservoir members in windows()
+  vector<vector<int> >& index = _index;
+  for (int s = 0; s < _param.strata; ++s)
+    index[s].assign(_reservoirs[s].size(), -1);
+
+  double raw = 0;
+  for (size_t s = 0; s < shares.size(); ++s)
+  {
+    const Share& share = shares[s];
+    const vector<Member>& ra = _reservoirs[share.a];
+    const vector<Member>& rb = _reservoirs[share.b];
+    boost::random::uniform_int_distribution<int> pick_a(0, (int)ra.size() - 1), pick_b(0, (int)rb.size() - 1);
+    for (int p = 0; p < share.pairs; ++p)
+    {
+      int i = pick_a(_rng), j = pick_b(_rng);
+      //pairs of equal gain prefer nothing and are dropped
+      if (ra[i].gain == rb[j].gain)
+        continue;
+      int si = share.a, sj = share.b;
+      if (ra[i].gain < rb[j].gain)
+      {
+        swap(i, j);
+        swap(si, sj);
+      }
+      const Member& better = _reservoirs[si][i];
+      const Member& worse = _reservoirs[sj][j];
+      if (index[si][i] < 0)
+      {
+        index[si][i] = (int)_windows.size();
+        _windows.push_back(better.window);
+      }
+      if (index[sj][j] < 0)
+      {
+        index[sj][j] = (int)_windows.size();
+        _windows.push_back(worse.window);
+      }
+      //unbiased for the sum over the population of the stratum pair
+      float weight = (float)((better.gain - worse.gain) * share.population / share.pairs);
+      _pairs.push_back(RankingTrainer::Pair(index[si][i], index[sj][j], weight));
+      raw += weight;
+    }
+  }
+
+  for (size_t p = 0; p < _pairs.size(); ++p)
+    _pairs[p].weight = (float)(_pairs[p].weight * _pairs.size() / raw);
+  return (int)_pairs.size();
+}
+
+size_t PairSampler::memoryBound() const
+{
+  //a reservoir member, its index and its entry of windows(), the gain scratch of one reservoir
+  size_t members = (size_t)_param.strata * _param.reservoir;
+  size_t shares = (size_t)_param.strata * (_param.strata + 1) / 2;
+  return members * (sizeof(Member) + 2*sizeof(int)) + (size_t)_param.reservoir * sizeof(uint32_t)
+    + (size_t)_param.pairs * sizeof(RankingTrainer::Pair) + shares * sizeof(Share)
+    + (size_t)_param.strata * (sizeof(long) + sizeof(std::vector<Member>) + sizeof(std::vector<int>));
+}
+
+void PairSampler::train(RankingTrainer& trainer, const float* dscr, size_t stride) const
+{
+  for (size_t b = 0; b < _pairs.size(); b += _param.batch)
+    trainer.train(dscr, stride, &_pairs[b], (int)min(_pairs.size() - b, (size_t)_param.batch));
+}
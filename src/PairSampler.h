@@ -0,0 +1,94 @@
+#ifndef PAIR_SAMPLER_H
+#define PAIR_SAMPLER_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <boost/random/mersenne_twister.hpp>
+
+#include "RankingTrainer.h"
+
+//Weighted preference pairs of one image without the O(|W|^2) pairs of its candidate windows. The
+//windows stream in with their marginal gains and fall into strata by gain (0, then one stratum per
+//power of two); each stratum keeps a uniform reservoir of its windows (J. Vitter, "Random sampling
+//with a reservoir", 1985). The pairs budget of the image is split over the stratum pairs by their
+//estimated total gain difference, and the pairs drawn from the reservoirs are importance weighted so
+//that the weights of an image sum to its pair count, in proportion to the total gain differences
+//they stand for. All storage is allocated by the constructor, strata*reservoir windows and pairs
+//plus per-stratum bookkeeping, whatever |W|.
+//
+//The pairs index the sampled windows only: extract the descriptors of windows() in that order and
+//train on them in mini-batches.
+class PairSampler
+{
+  public:
+    struct Param
+    {
+      int strata;      //the last stratum takes every larger gain
+      int reservoir;   //windows kept per stratum
+      int pairs;       //pairs per image
+      int batch;       //pairs per RankingTrainer::train call
+      unsigned int seed;
+      Param(int st = 16, int r = 256, int p = 4096, int b = 1024, unsigned int s = 1):strata(st),reservoir(r),pairs(p),batch(b),seed(s){}
+    };
+
+    PairSampler(Param& param);
+
+    //starts an image
+    void begin();
+    //candidate window of the image (any id, e.g. its index in the lattice) with its marginal gain
+    void add(int window, uint32_t gain);
+    //draws the pairs of the image from the reservoirs; returns their number
+    int sample();
+
+    //ids of the sampled windows, pair indices refer to this order
+    inline const std::vector<int>& windows() const { return _windows; }
+    inline const std::vector<RankingTrainer::Pair>& pairs() const { return _pairs; }
+    //windows seen since begin
+    inline long seen() const { return _seen; }
+    //bytes held for any number of windows, everything the constructor allocates
+    size_t memoryBound() const;
+
+    //feeds the pairs to the trainer in mini-batches, descriptor k of windows() at dscr + k*stride
+    void train(RankingTrainer& trainer, const float* dscr, size_t stride) const;
+
+  private:
+    struct Member
+    {
+      int window;
+      uint32_t gain;
+      Member(int w = 0, uint32_t g = 0):window(w),gain(g){}
+    };
+
+    //stratum pair (a, b), a >= b, with its share of the pairs budget
+    struct Share
+    {
+      int a;
+      int b;
+      double population;
+      double weight;   //population * mean gain difference
+      int pairs;
+      double remainder;
+      Share(int sa, int sb, double p, double w):a(sa),b(sb),population(p),weight(w),pairs(0),remainder(0){}
+    };
+    static inline bool byRemainder(const Share& x, const Share& y) { return x.remainder > y.remainder; }
+
+    int stratum(uint32_t gain) const;
+    //E|g_i - g_j| of two members of reservoir a and b, exact over the reservoirs
+    double meanDifference(int a, int b);
+
+    Param _param;
+    boost::random::mt19937 _rng;
+    std::vector<std::vector<Member> > _reservoirs;
+    std::vector<long> _counts;   //windows seen per stratum
+    long _seen;
+    std::vector<int> _windows;
+    std::vector<RankingTrainer::Pair> _pairs;
+    //scratch of sample: the stratum pairs, the index of each reservoir member in _windows and the
+    //sorted gains of meanDifference
+    std::vector<Share> _shares;
+    std::vector<std::vector<int> > _index;
+    std::vector<uint32_t> _gains;
+};
+
+#endif //PAIR_SAMPLER_H
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include "RankingTrainer.h"
+#include "parallel.h"
+
+using namespace std;
+
+namespace
+{
+  inline float dot(const float* a, const float* b, int n)
+  {
+    float sum = 0;
+    for (int d = 0; d < n; ++d)
+      sum += a[d]*b[d];
+    return sum;
+  }
+}
+
+//pairs [begin, end) of a shuffled order on one thread
+struct RankingTrainer::UpdatePairs
+{
+  RankingTrainer* trainer;
+  const float* dscr;
+  size_t stride;
+  const Pair* pairs;
+  const int* order;
+  UpdatePairs(RankingTrainer* t, const float* d, size_t s, const Pair* p, const int* o)
+    :trainer(t),dscr(d),stride(s),pairs(p),order(o){}
+  void operator()(int begin, int end) { trainer->update(dscr, stride, pairs, order, begin, end); }
+};
+
+RankingTrainer::RankingTrainer(Param& param, int length)
+  :_param(param),_length(length),_epoch(0)
+{
+  if (length < 1)
+    throw runtime_error( boost::str(boost::format("Invalid descriptor length %1%") % length) );
+  reset();
+}
+
+void RankingTrainer::reset()
+{
+  _weights.assign(_length, 0);
+  _squares.assign(_length, 0);
+  _epoch = 0;
+}
+
+void RankingTrainer::update(const float* dscr, size_t stride, const Pair* pairs, const int* order, int begin, int end)
+{
+  float* w = &_weights[0];
+  float* squares = &_squares[0];
+  for (int n = begin; n < end; ++n)
+  {
+    const Pair& pair = pairs[order[n]];
+    const float* better = dscr + pair.better*stride;
+    const float* worse = dscr + pair.worse*stride;
+    if (dot(w, better, _length) - dot(w, worse, _length) >= 1)
+      continue;
+    for (int d = 0; d < _length; ++d)
+    {
+      float g = _param.lambda*w[d] - pair.weight*(better[d] - worse[d]);
+      if (g == 0)
+        continue;
+      squares[d] += g*g;
+      w[d] -= _param.learning_rate * g / sqrt(squares[d]);
+    }
+  }
+}
+
+void RankingTrainer::train(const float* dscr, size_t stride, const Pair* pairs, int count)
+{
+  if (count <= 0)
+    return;
+  _order.resize(count);
+  for (int k = 0; k < count; ++k)
+    _order[k] = k;
+
+  for (int e = 0; e < _param.epochs; ++e)
+  {
+    boost::random::mt19937 rng(_param.seed + _epoch++);
+    for (int k = count - 1; k > 0; --k)
+    {
+      boost::random::uniform_int_distribution<int> pick(0, k);
+      swap(_order[k], _order[pick(rng)]);
+    }
+    parallel_for(0, count, _param.nthreads, UpdatePairs(this, dscr, stride, pairs, &_order[0]));
+  }
+}
+
+float RankingTrainer::score(const float* dscr) const
+{
+  return dot(&_weights[0], dscr, _length);
+}
+
+void RankingTrainer::evaluate(double& loss, double& accuracy, const float* dscr, size_t stride, const Pair* pairs, int count) const
+{
+  double total = 0;
+  loss = 0;
+  accuracy = 0;
+  for (int k = 0; k < count; ++k)
+  {
+    float margin = score(dscr + pairs[k].better*stride) - score(dscr + pairs[k].worse*stride);
+    loss += pairs[k].weight * max(0.0f, 1 - margin);
+    accuracy += margin > 0 ? pairs[k].weight : 0;
+    total += pairs[k].weight;
+  }
+  if (total > 0)
+  {
+    loss /= total;
+    accuracy /= total;
+  }
+}
+
+void RankingTrainer::allPairs(vector<Pair>& pairs, const uint32_t* gains, int count)
+{
+  pairs.clear();
+  for (int i = 0; i < count; ++i)
+    for (int j = 0; j < count; ++j)
+      if (gains[i] > gains[j])
+        pairs.push_back(Pair(i, j, (float)(gains[i] - gains[j])));
+}
+
+void RankingTrainer::save(const char* fn) const
+{
+  ofstream fout(fn);
+  if (!fout.good())
+    throw runtime_error( boost::str(boost::format("Failed to open %1%") % fn) );
+  fout.precision(9);
+  fout << _length << "\n";
+  for (int d = 0; d < _length; ++d)
+    fout << _weights[d] << "\n";
+}
+
+void RankingTrainer::load(const char* fn)
+{
+  ifstream fin(fn);
+  if (!fin.good())
+    throw runtime_error( boost::str(boost::format("Failed to open %1%") % fn) );
+  int length = 0;
+  fin >> length;
+  if (length != _length)
+    throw runtime_error( boost::str(boost::format("%1% holds %2% weights, not %3%") % fn % length % _length) );
+  reset();
+  for (int d = 0; d < _length; ++d)
+    fin >> _weights[d];
+  if (!fin)
+    throw runtime_error( boost::str(boost::format("Failed to read the weights of %1%") % fn) );
+}
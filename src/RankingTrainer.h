@@ -0,0 +1,72 @@
+#ifndef RANKING_TRAINER_H
+#define RANKING_TRAINER_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+//Linear ranking machine of one ConSeqOpt slot, trained in process on the descriptor buffers of
+//HOGExtractor instead of through Vowpal Wabbit files. A pair prefers window "better" to "worse" by
+//weight, the marginal gain difference: the loss is weight * max(0, 1 - w . (x_better - x_worse))
+//+ lambda/2 |w|^2, minimized by AdaGrad (J. Duchi, E. Hazan and Y. Singer, "Adaptive subgradient
+//methods for online learning and stochastic optimization", JMLR 2011). With nthreads > 1 the
+//threads update the shared weights without locks (B. Recht et al., "Hogwild!", NIPS 2011); the
+//result then depends on the thread interleaving.
+class RankingTrainer
+{
+  public:
+    struct Param
+    {
+      float learning_rate;
+      float lambda;        //L2 regularization, applied with the updates of violated pairs
+      int epochs;          //passes over the pairs of a train call
+      int nthreads;
+      unsigned int seed;   //pair order of each epoch
+      Param(float lr = 0.1f, float l = 1e-4f, int e = 1, int nt = 1, unsigned int s = 1):learning_rate(lr),lambda(l),epochs(e),nthreads(nt),seed(s){}
+    };
+
+    //indices of two descriptors of the buffer passed to train
+    struct Pair
+    {
+      int better;
+      int worse;
+      float weight;
+      Pair(int b = 0, int w = 0, float wt = 1):better(b),worse(w),weight(wt){}
+    };
+
+    RankingTrainer(Param& param, int length);
+
+    inline int length() const { return _length; }
+    inline const float* weights() const { return &_weights[0]; }
+    //starts over from zero weights
+    void reset();
+
+    //descriptor k of the buffer at dscr + k*stride. The AdaGrad state carries over from call to call,
+    //so pairs can be fed in mini-batches
+    void train(const float* dscr, size_t stride, const Pair* pairs, int count);
+    float score(const float* dscr) const;
+    //weighted hinge loss (without regularization) and weighted fraction of pairs ranked right
+    void evaluate(double& loss, double& accuracy, const float* dscr, size_t stride, const Pair* pairs, int count) const;
+
+    //every pair of count windows with different gains, O(count^2): for small candidate sets
+    static void allPairs(std::vector<Pair>& pairs, const uint32_t* gains, int count);
+
+    //text file: length, then the weights
+    void save(const char* fn) const;
+    void load(const char* fn);
+
+  private:
+    //thread functor of train, calls update
+    struct UpdatePairs;
+    //one thread's share of an epoch
+    void update(const float* dscr, size_t stride, const Pair* pairs, const int* order, int begin, int end);
+
+    Param _param;
+    int _length;
+    std::vector<float> _weights;
+    std::vector<float> _squares;   //AdaGrad sums of squared gradients
+    std::vector<int> _order;
+    unsigned int _epoch;
+};
+
+#endif //RANKING_TRAINER_H
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include "UncoveredMap.h"
+
+using namespace std;
+
+namespace
+{
+  inline int lowbit(int i) { return i & -i; }
+}
+
+void UncoveredMap::reset(const CoverageMap& coverage)
+{
+  _window_width = coverage.windowWidth();
+  _window_height = coverage.windowHeight();
+  _widths.resize(coverage.levels());
+  _heights.resize(coverage.levels());
+  _words.resize(coverage.levels());
+  _trees.resize(coverage.levels());
+  _bits.resize(coverage.levels());
+  _covered = 0;
+
+  for (int l = 0; l < coverage.levels(); ++l)
+  {
+    int w = coverage.width(l), h = coverage.height(l);
+    _widths[l] = w;
+    _heights[l] = h;
+
+    //node (x, y) sums the pixels of (x - lowbit(x), x] x (y - lowbit(y), y], one integral image
+    //query apiece instead of w*h updates
+    vector<int32_t>& tree = _trees[l];
+    tree.assign((size_t)(w + 1)*(h + 1), 0);
+    for (int y = 1; y <= h; ++y)
+      for (int x = 1; x <= w; ++x)
+        tree[(size_t)y*(w + 1) + x] = coverage.count(l, x - lowbit(x), y - lowbit(y), x - 1, y - 1);
+
+    _words[l] = (w + 63) / 64;
+    vector<uint64_t>& bits = _bits[l];
+    bits.assign((size_t)_words[l]*h, 0);
+    const uint8_t* mask = coverage.mask(l);
+    for (int y = 0; y < h; ++y)
+      for (int x = 0; x < w; ++x)
+        if (mask[(size_t)y*w + x])
+          bits[(size_t)y*_words[l] + x/64] |= (uint64_t)1 << (x % 64);
+  }
+}
+
+uint32_t UncoveredMap::prefix(int level, int x, int y) const
+{
+  const vector<int32_t>& tree = _trees[level];
+  size_t stride = _widths[level] + 1;
+  int32_t sum = 0;
+  for (int j = y; j > 0; j -= lowbit(j))
+    for (int i = x; i > 0; i -= lowbit(i))
+      sum += tree[j*stride + i];
+  return (uint32_t)sum;
+}
+
+void UncoveredMap::remove(int level, int x, int y)
+{
+  vector<int32_t>& tree = _trees[level];
+  size_t stride = _widths[level] + 1;
+  for (int j = y + 1; j <= _heights[level]; j += lowbit(j))
+    for (int i = x + 1; i <= _widths[level]; i += lowbit(i))
+      tree[j*stride + i] -= 1;
+}
+
+uint32_t UncoveredMap::uncovered(int x, int y, int level) const
+{
+  if (level < 0 || level >= levels())
+    throw runtime_error( boost::str(boost::format("Level %1% is outside the %2% levels") % level % levels()) );
+  int x0 = max(x, 0), y0 = max(y, 0);
+  int x1 = min(x + _window_width, _widths[level]), y1 = min(y + _window_height, _heights[level]);
+  if (x1 <= x0 || y1 <= y0)
+    return 0;
+  return prefix(level, x1, y1) - prefix(level, x0, y1) - prefix(level, x1, y0) + prefix(level, x0, y0);
+}
+
+uint32_t UncoveredMap::markCovered(int x, int y, int level)
+{
+  if (level < 0 || level >= levels())
+    throw runtime_error( boost::str(boost::format("Level %1% is outside the %2% levels") % level % levels()) );
+  int x0 = max(x, 0), y0 = max(y, 0);
+  int x1 = min(x + _window_width, _widths[level]), y1 = min(y + _window_height, _heights[level]);
+  uint32_t gain = 0;
+  for (int yy = y0; yy < y1; ++yy)
+  {
+    uint64_t* row = &_bits[level][(size_t)yy*_words[level]];
+    for (int wd = x0/64; wd <= (x1 - 1)/64 && x0 < x1; ++wd)
+    {
+      //the bits of [x0, x1) in this word
+      uint64_t span = ~(uint64_t)0;
+      if (wd == x0/64)
+        span &= ~(uint64_t)0 << (x0 % 64);
+      if (wd == (x1 - 1)/64 && x1 % 64 != 0)
+        span &= ((uint64_t)1 << (x1 % 64)) - 1;
+      uint64_t hit = row[wd] & span;
+      row[wd] &= ~span;
+      while (hit)
+      {
+        remove(level, wd*64 + __builtin_ctzll(hit), yy);
+        hit &= hit - 1;
+        ++gain;
+      }
+    }
+  }
+  _covered += gain;
+  return gain;
+}
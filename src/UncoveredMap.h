@@ -0,0 +1,45 @@
+#ifndef UNCOVERED_MAP_H
+#define UNCOVERED_MAP_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "CoverageMap.h"
+
+//Ground truth pixels of a CoverageMap not yet covered by the chosen windows A, for the marginal gain
+//f_G(A + a) - f_G(A) = uncovered pixels under a of greedy window selection. Every level keeps a 2D
+//Fenwick tree of the uncovered pixels, so the gain of a window takes O(log w log h), and a bitset of
+//them, so covering a window visits only the pixels it uncovers (each pixel once over a selection)
+//at O(log w log h) apiece.
+class UncoveredMap
+{
+  public:
+    UncoveredMap():_covered(0){}
+
+    //every ground truth pixel of the map is uncovered
+    void reset(const CoverageMap& coverage);
+
+    inline int levels() const { return (int)_widths.size(); }
+    //uncovered ground truth pixels under the window with top-left corner (x, y) of a level
+    uint32_t uncovered(int x, int y, int level) const;
+    //removes the pixels under the window from the uncovered set; returns their number, the gain
+    uint32_t markCovered(int x, int y, int level);
+    //f_G(A), the pixels covered so far
+    inline uint32_t covered() const { return _covered; }
+
+  private:
+    //uncovered pixels of [0, x) x [0, y)
+    uint32_t prefix(int level, int x, int y) const;
+    void remove(int level, int x, int y);
+
+    int _window_width;
+    int _window_height;
+    std::vector<int> _widths;
+    std::vector<int> _heights;
+    std::vector<std::vector<int32_t> > _trees;   //(width + 1) x (height + 1), row major, 1-based
+    std::vector<std::vector<uint64_t> > _bits;   //row y at y*words(level), bit x%64 of word x/64
+    std::vector<int> _words;
+    uint32_t _covered;
+};
+
+#endif //UNCOVERED_MAP_H
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include "WindowSelector.h"
+
+using namespace std;
+
+long WindowSelector::select(vector<int>& sequence, vector<uint32_t>& gains, const CoverageMap& coverage, const int32_t* windows, int count)
+{
+  if (_param.type == stochastic_greedy && !(_param.epsilon > 0 && _param.epsilon < 1))
+    throw runtime_error( boost::str(boost::format("Stochastic greedy epsilon %1% is not in (0, 1)") % _param.epsilon) );
+  for (int k = 0; k < count; ++k)
+    if (windows[3*k + 2] < 0 || windows[3*k + 2] >= coverage.levels())
+      throw runtime_error( boost::str(boost::format("Window %1% is on level %2% of %3%") % k % windows[3*k + 2] % coverage.levels()) );
+
+  sequence.clear();
+  gains.clear();
+  _uncovered.reset(coverage);
+  switch (_param.type)
+  {
+    case greedy:
+      return selectGreedy(sequence, gains, windows, count);
+    case lazy_greedy:
+      return selectLazy(sequence, gains, windows, count);
+    default:
+      return selectStochastic(sequence, gains, windows, count, coverage.total());
+  }
+}
+
+//every remaining candidate each round, ties to the lowest index
+long WindowSelector::selectGreedy(vector<int>& sequence, vector<uint32_t>& gains, const int32_t* windows, int count)
+{
+  vector<bool> chosen(count, false);
+  long evaluations = 0;
+  for (int round = 0; round < _param.budget; ++round)
+  {
+    int best = -1;
+    uint32_t best_gain = 0;
+    for (int k = 0; k < count; ++k)
+    {
+      if (chosen[k])
+        continue;
+      uint32_t gain = _uncovered.uncovered(windows[3*k], windows[3*k + 1], windows[3*k + 2]);
+      ++evaluations;
+      if (gain > best_gain)
+      {
+        best = k;
+        best_gain = gain;
+      }
+    }
+    if (best < 0)
+      break;
+    chosen[best] = true;
+    sequence.push_back(best);
+    gains.push_back(_uncovered.markCovered(windows[3*best], windows[3*best + 1], windows[3*best + 2]));
+  }
+  return evaluations;
+}
+
+//heap of (gain bound, -index), fresh[k] the round the bound of k was evaluated in: the order breaks
+//ties to the lowest index like greedy, so both select the same sequence. Windows without gain never
+//gain again and are dropped
+long WindowSelector::selectLazy(vector<int>& sequence, vector<uint32_t>& gains, const int32_t* windows, int count)
+{
+  typedef pair<uint32_t, int> Entry;
+  priority_queue<Entry> heap;
+  vector<int> fresh(count, 0);
+  long evaluations = 0;
+  for (int k = 0; k < count; ++k)
+  {
+    uint32_t gain = _uncovered.uncovered(windows[3*k], windows[3*k + 1], windows[3*k + 2]);
+    ++evaluations;
+    if (gain > 0)
+      heap.push(Entry(gain, -k));
+  }
+
+  for (int round = 0; round < _param.budget && !heap.empty(); )
+  {
+    Entry top = heap.top();
+    heap.pop();
+    int k = -top.second;
+    if (fresh[k] == round)
+    {
+      sequence.push_back(k);
+      gains.push_back(_uncovered.markCovered(windows[3*k], windows[3*k + 1], windows[3*k + 2]));
+      ++round;
+      continue;
+    }
+    uint32_t gain = _uncovered.uncovered(windows[3*k], windows[3*k + 1], windows[3*k + 2]);
+    ++evaluations;
+    fresh[k] = round;
+    if (gain > 0)
+      heap.push(Entry(gain, -k));
+  }
+  return evaluations;
+}
+
+//a partial Fisher-Yates shuffle of the remaining candidates draws the sample of each round; the
+//sequence ends once all total ground truth pixels are covered, no sample can gain after that
+long WindowSelector::selectStochastic(vector<int>& sequence, vector<uint32_t>& gains, const int32_t* windows, int count, uint32_t total)
+{
+  boost::random::mt19937 rng(_param.seed);
+  vector<int> remaining(count);
+  for (int k = 0; k < count; ++k)
+    remaining[k] = k;
+  int sample = (int)ceil((double)count / max(_param.budget, 1) * log(1.0 / _param.epsilon));
+  sample = max(1, min(sample, count));
+
+  long evaluations = 0;
+  for (int round = 0; round < _param.budget && !remaining.empty() && _uncovered.covered() < total; ++round)
+  {
+    int best = -1;
+    uint32_t best_gain = 0;
+    for (int drawn = 0, s = 0; drawn < sample && s < (int)remaining.size(); ++drawn)
+    {
+      boost::random::uniform_int_distribution<int> pick(s, (int)remaining.size() - 1);
+      swap(remaining[s], remaining[pick(rng)]);
+      int k = remaining[s];
+      uint32_t gain = _uncovered.uncovered(windows[3*k], windows[3*k + 1], windows[3*k + 2]);
+      ++evaluations;
+      //a window without gain never gains again and leaves the candidates, as in lazy greedy
+      if (gain == 0)
+      {
+        remaining[s] = remaining.back();
+        remaining.pop_back();
+        continue;
+      }
+      if (gain > best_gain)
+      {
+        best = s;
+        best_gain = gain;
+      }
+      ++s;
+    }
+    //an empty sample does not end the sequence, gains may remain outside it
+    if (best < 0)
+      continue;
+    int k = remaining[best];
+    remaining[best] = remaining.back();
+    remaining.pop_back();
+    sequence.push_back(k);
+    gains.push_back(_uncovered.markCovered(windows[3*k], windows[3*k + 1], windows[3*k + 2]));
+  }
+  return evaluations;
+}
+
+void WindowSelector::lattice(vector<int32_t>& windows, const CoverageMap& coverage, int stride)
+{
+  if (stride < 1)
+    throw runtime_error( boost::str(boost::format("Invalid lattice stride %1%") % stride) );
+  windows.clear();
+  for (int l = 0; l < coverage.levels(); ++l)
+    for (int y = 0; y + coverage.windowHeight() <= coverage.height(l); y += stride)
+      for (int x = 0; x + coverage.windowWidth() <= coverage.width(l); x += stride)
+      {
+        windows.push_back(x);
+        windows.push_back(y);
+        windows.push_back(l);
+      }
+}
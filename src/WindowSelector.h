@@ -0,0 +1,59 @@
+#ifndef WINDOW_SELECTOR_H
+#define WINDOW_SELECTOR_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "CoverageMap.h"
+#include "UncoveredMap.h"
+
+//Greedy maximization of the coverage utility f_G over candidate windows [x y level]: the oracle
+//sequences ConSeqOpt is trained against. Every round adds the window of largest marginal gain
+//(uncovered ground truth pixels under it) until budget windows are chosen or no window gains.
+//
+//greedy evaluates every remaining candidate each round. lazy_greedy keeps the gains of earlier
+//rounds in a max heap as upper bounds (gains only shrink, f_G is submodular) and re-evaluates the
+//top until it is fresh; it selects exactly the greedy sequence (M. Minoux, "Accelerated greedy
+//algorithms for maximizing submodular set functions", 1978). stochastic_greedy evaluates a random
+//sample of (n / budget) log(1 / epsilon) remaining candidates per round, 1 - 1/e - epsilon of the
+//optimum in expectation (B. Mirzasoleiman et al., "Lazier than lazy greedy", AAAI 2015); it drops
+//the sampled windows without gain and stops once all ground truth is covered.
+class WindowSelector
+{
+  public:
+    enum selection_type
+    {
+      greedy,
+      lazy_greedy,
+      stochastic_greedy
+    };
+
+    struct Param
+    {
+      selection_type type;
+      int budget;        //windows per sequence
+      float epsilon;     //stochastic_greedy sample size, in (0, 1)
+      unsigned int seed;
+      Param(selection_type t = lazy_greedy, int b = 10, float e = 0.1f, unsigned int s = 1):type(t),budget(b),epsilon(e),seed(s){}
+    };
+
+    WindowSelector(Param& param):_param(param){}
+
+    //count windows [x y level] of a flat array on the levels of coverage; sequence gets the indices
+    //of the chosen windows in order and gains their marginal gains. Returns the number of marginal
+    //gain evaluations
+    long select(std::vector<int>& sequence, std::vector<uint32_t>& gains, const CoverageMap& coverage, const int32_t* windows, int count);
+
+    //candidate windows on a lattice of stride pixels of every level
+    static void lattice(std::vector<int32_t>& windows, const CoverageMap& coverage, int stride);
+
+  private:
+    long selectGreedy(std::vector<int>& sequence, std::vector<uint32_t>& gains, const int32_t* windows, int count);
+    long selectLazy(std::vector<int>& sequence, std::vector<uint32_t>& gains, const int32_t* windows, int count);
+    long selectStochastic(std::vector<int>& sequence, std::vector<uint32_t>& gains, const int32_t* windows, int count, uint32_t total);
+
+    Param _param;
+    UncoveredMap _uncovered;
+};
+
+#endif //WINDOW_SELECTOR_H
@@ -0,0 +1,140 @@
+//Marginal gain evaluations and coverage of greedy, lazy greedy and stochastic greedy window selection
+//over the annotated training images
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/time.h>
+#include <boost/lexical_cast.hpp>
+#include "WindowSelector.h"
+
+using namespace std;
+
+void help_exit(const char* app_name)
+{
+  cout << "usage: " << app_name << " [options] \n"
+    << "\t-r \t data root, default ../../inria\n"
+    << "\t-f \t folder with annotations.lst, default Train\n"
+    << "\t-n \t number of images, default all\n"
+    << "\t-N \t windows per sequence, default 10\n"
+    << "\t-s \t lattice stride in level pixels, default 8\n"
+    << "\t-S \t pyramid scale step, default 1.2\n"
+    << "\t-e \t stochastic greedy epsilon, default 0.1\n"
+    << "\t-h \t display this message\n";
+  exit(1);
+}
+
+double now()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+struct Totals
+{
+  double evaluations;
+  double covered;
+  double seconds;
+  int same;   //images whose sequence equals the greedy one
+  Totals():evaluations(0),covered(0),seconds(0),same(0){}
+};
+
+int main(int argc, char** argv)
+{
+  string root = "../../inria", folder = "Train";
+  int nimages = -1, stride = 8;
+  FeaturePyramid::Param pyramid_param(1.2f, 64, 128);
+  WindowSelector::Param selector_param;
+
+  int c;
+  while ((c = getopt(argc, argv, "r:f:n:N:s:S:e:h")) != -1)
+  {
+    switch (c)
+    {
+      case 'r':
+        root = optarg;
+        break;
+      case 'f':
+        folder = optarg;
+        break;
+      case 'n':
+        nimages = boost::lexical_cast<int>(optarg);
+        break;
+      case 'N':
+        selector_param.budget = boost::lexical_cast<int>(optarg);
+        break;
+      case 's':
+        stride = boost::lexical_cast<int>(optarg);
+        break;
+      case 'S':
+        pyramid_param.scale_step = boost::lexical_cast<float>(optarg);
+        break;
+      case 'e':
+        selector_param.epsilon = boost::lexical_cast<float>(optarg);
+        break;
+      case 'h':
+      case '?':
+      default:
+        help_exit(argv[0]);
+        break;
+    }
+  }
+
+  AnnotationReader reader(root, folder);
+  CoverageMap coverage(pyramid_param);
+  const WindowSelector::selection_type types[3] = {WindowSelector::greedy, WindowSelector::lazy_greedy, WindowSelector::stochastic_greedy};
+  const char* names[3] = {"greedy", "lazy", "stochastic"};
+  Totals totals[3];
+  double ground_truth = 0, candidates = 0;
+  int images = 0;
+
+  vector<int32_t> windows;
+  vector<int> sequence, greedy_sequence;
+  vector<uint32_t> gains;
+  for (size_t i = 0; i < reader._images_info.size() && (nimages < 0 || images < nimages); ++i)
+  {
+    const Image_Info& info = reader._images_info[i];
+    if (info.width <= 0 || info.height <= 0)
+    {
+      cerr << "no image size for " << info.image_name << "\n";
+      continue;
+    }
+    coverage.build(info);
+    WindowSelector::lattice(windows, coverage, stride);
+    int count = (int)windows.size() / 3;
+    if (count == 0)
+      continue;
+    ++images;
+    ground_truth += coverage.total();
+    candidates += count;
+
+    for (int t = 0; t < 3; ++t)
+    {
+      selector_param.type = types[t];
+      WindowSelector selector(selector_param);
+      double start = now();
+      totals[t].evaluations += selector.select(sequence, gains, coverage, &windows[0], count);
+      totals[t].seconds += now() - start;
+      for (size_t k = 0; k < gains.size(); ++k)
+        totals[t].covered += gains[k];
+      if (t == 0)
+        greedy_sequence = sequence;
+      totals[t].same += sequence == greedy_sequence;
+    }
+  }
+  if (images == 0)
+  {
+    cerr << "no annotated image under " << root << "/" << folder << "\n";
+    return 1;
+  }
+
+  cout << images << " images, " << candidates / images << " candidate windows per image on a " << stride << " pixel lattice, "
+    << selector_param.budget << " windows per sequence\n"
+    << "selection\tevaluations/image\tsaved\tcoverage\tsame as greedy\tms/image\n";
+  for (int t = 0; t < 3; ++t)
+    cout << names[t] << "\t" << totals[t].evaluations / images << "\t" << 1 - totals[t].evaluations / totals[0].evaluations
+      << "\t" << (ground_truth > 0 ? totals[t].covered / ground_truth : 0) << "\t" << totals[t].same << "/" << images
+      << "\t" << totals[t].seconds / images * 1e3 << "\n";
+  return 0;
+}
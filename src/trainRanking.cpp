@@ -0,0 +1,187 @@
+//Trains the ranking machine of one ConSeqOpt slot over the annotated training images: the marginal
+//gains of every lattice window stream into a PairSampler, only the sampled windows are extracted and
+//their pairs go to the RankingTrainer in mini-batches
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/time.h>
+#include <boost/lexical_cast.hpp>
+#include "WindowSelector.h"
+#include "PairSampler.h"
+#include "RankingTrainer.h"
+
+using namespace std;
+
+void help_exit(const char* app_name)
+{
+  cout << "usage: " << app_name << " [options] \n"
+    << "\t-r \t data root, default ../../inria\n"
+    << "\t-f \t folder with annotations.lst, default Train\n"
+    << "\t-n \t number of images, default all\n"
+    << "\t-k \t slot, the first k - 1 windows of the greedy oracle are covered, default 1\n"
+    << "\t-s \t lattice stride in level pixels, default 8\n"
+    << "\t-S \t pyramid scale step, default 1.2\n"
+    << "\t-p \t pairs per image, default 4096\n"
+    << "\t-R \t windows kept per gain stratum, default 256\n"
+    << "\t-b \t pairs per mini-batch, default 1024\n"
+    << "\t-t \t number of threads, default 1\n"
+    << "\t-o \t save the weights\n"
+    << "\t-h \t display this message\n";
+  exit(1);
+}
+
+double now()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+int main(int argc, char** argv)
+{
+  string root = "../../inria", folder = "Train";
+  const char* fout = 0;
+  int nimages = -1, slot = 1, stride = 8;
+  FeaturePyramid::Param pyramid_param(1.2f, 64, 128);
+  PairSampler::Param sampler_param;
+  RankingTrainer::Param trainer_param;
+
+  int c;
+  while ((c = getopt(argc, argv, "r:f:n:k:s:S:p:R:b:t:o:h")) != -1)
+  {
+    switch (c)
+    {
+      case 'r':
+        root = optarg;
+        break;
+      case 'f':
+        folder = optarg;
+        break;
+      case 'n':
+        nimages = boost::lexical_cast<int>(optarg);
+        break;
+      case 'k':
+        slot = boost::lexical_cast<int>(optarg);
+        break;
+      case 's':
+        stride = boost::lexical_cast<int>(optarg);
+        break;
+      case 'S':
+        pyramid_param.scale_step = boost::lexical_cast<float>(optarg);
+        break;
+      case 'p':
+        sampler_param.pairs = boost::lexical_cast<int>(optarg);
+        break;
+      case 'R':
+        sampler_param.reservoir = boost::lexical_cast<int>(optarg);
+        break;
+      case 'b':
+        sampler_param.batch = boost::lexical_cast<int>(optarg);
+        break;
+      case 't':
+        trainer_param.nthreads = boost::lexical_cast<int>(optarg);
+        break;
+      case 'o':
+        fout = optarg;
+        break;
+      case 'h':
+      case '?':
+      default:
+        help_exit(argv[0]);
+        break;
+    }
+  }
+
+  //8x16 cells of 8 pixels on a 64x128 window
+  IntegralHistogram::Param inthist_param;
+  HOGExtractor::Param hog_param(8, 16);
+  FeaturePyramid pyramid(pyramid_param, inthist_param, hog_param);
+  CoverageMap coverage(pyramid_param);
+  WindowSelector::Param selector_param(WindowSelector::lazy_greedy, slot - 1);
+  WindowSelector selector(selector_param);
+  UncoveredMap uncovered;
+  PairSampler sampler(sampler_param);
+  RankingTrainer trainer(trainer_param, pyramid.length());
+
+  AnnotationReader reader(root, folder);
+  cimg::exception_mode() = 0;
+  vector<int32_t> windows, sampled;
+  vector<int> sequence;
+  vector<uint32_t> gains;
+  double windows_seen = 0, pairs = 0, accuracy = 0, t_sample = 0, t_extract = 0, t_train = 0;
+  int images = 0;
+  for (size_t i = 0; i < reader._images_info.size() && (nimages < 0 || images < nimages); ++i)
+  {
+    const Image_Info& info = reader._images_info[i];
+    Image im;
+    try
+    {
+      im.load(info.image_name.c_str());
+    }
+    catch (CImgException&)
+    {
+      cerr << "can not load " << info.image_name << "\n";
+      continue;
+    }
+
+    //gains of slot k: the ground truth left by the oracle's first k - 1 windows
+    double start = now();
+    coverage.build(info, im.dimx(), im.dimy());
+    WindowSelector::lattice(windows, coverage, stride);
+    int count = (int)windows.size() / 3;
+    if (count == 0)
+      continue;
+    uncovered.reset(coverage);
+    if (slot > 1)
+    {
+      selector.select(sequence, gains, coverage, &windows[0], count);
+      for (size_t k = 0; k < sequence.size(); ++k)
+        uncovered.markCovered(windows[3*sequence[k]], windows[3*sequence[k] + 1], windows[3*sequence[k] + 2]);
+    }
+    sampler.begin();
+    for (int k = 0; k < count; ++k)
+      sampler.add(k, uncovered.uncovered(windows[3*k], windows[3*k + 1], windows[3*k + 2]));
+    int npairs = sampler.sample();
+    t_sample += now() - start;
+    if (npairs == 0)
+      continue;
+
+    start = now();
+    pyramid.build(im);
+    const vector<int>& ids = sampler.windows();
+    sampled.resize(3*ids.size());
+    for (size_t k = 0; k < ids.size(); ++k)
+      for (int j = 0; j < 3; ++j)
+        sampled[3*k + j] = windows[3*ids[k] + j];
+    DescriptorBuffer dscr((int)ids.size(), pyramid.length());
+    pyramid.extract(dscr.data(), dscr.stride(), &sampled[0], (int)ids.size());
+    t_extract += now() - start;
+
+    //progressive validation: the pairs of an image are scored before training on them
+    double loss, correct;
+    trainer.evaluate(loss, correct, dscr.data(), dscr.stride(), &sampler.pairs()[0], npairs);
+    accuracy += correct;
+    start = now();
+    sampler.train(trainer, dscr.data(), dscr.stride());
+    t_train += now() - start;
+
+    ++images;
+    windows_seen += count;
+    pairs += npairs;
+  }
+  if (images == 0)
+  {
+    cerr << "no annotated image could be loaded under " << root << "/" << folder << "\n";
+    return 1;
+  }
+
+  cout << images << " images, slot " << slot << ", " << windows_seen / images << " windows and " << pairs / images
+    << " pairs per image, sampler memory bound " << sampler.memoryBound() / 1024 << " KB\n"
+    << "per image: sampling " << t_sample / images * 1e3 << " ms, extraction " << t_extract / images * 1e3
+    << " ms, training " << t_train / images * 1e3 << " ms\n"
+    << "progressive weighted pair accuracy " << accuracy / images << "\n";
+  if (fout != 0)
+    trainer.save(fout);
+  return 0;
+}